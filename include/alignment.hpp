@@ -52,6 +52,7 @@ class References;
 class Output;
 struct Readstats;
 class Refstats;
+struct Workspace;
 
 using namespace std;
 
@@ -60,6 +61,11 @@ using namespace std;
            per read */
 #define BEST_HITS_INCREMENT 100
 
+/*! @brief Number of candidate references whose first
+           SW windows are scored together, one per SIMD lane
+           (16 x int16 i.e. one AVX2 register) */
+#define SW_BATCH 16
+
 /*! @brief Euler's constant */
 #define EXP 2.71828182845904523536
 
@@ -98,10 +104,12 @@ typedef pair<uint32_t,uint32_t> uint32pair;
 /*! @fn find_lis()
  *  @brief Given a list of matching positions on the read, find the longest
            strictly increasing subsequence, O(n log k)
-    @param deque<pair<uint32_t, uint32_t> > &a  list of matching positions on the read which fall within a range of the read's length on the genome
+    @param const pair<uint32_t, uint32_t>* a  list of matching positions on the read which fall within a range of the read's length on the genome
+    @param size_t n  number of elements in 'a'
     @param vector<uint32_t> &b  array of starting positions of each longest subsequence
+    @param vector<uint32_t> &p  scratch buffer for the predecessor links
 */
-void find_lis(deque<pair<uint32_t, uint32_t> > &a, vector<uint32_t> &b);
+void find_lis(const pair<uint32_t, uint32_t>* a, std::size_t n, vector<uint32_t> &b, vector<uint32_t> &p);
 
 /*
  * called on each idx * part * read * strand * [1..max opts.skiplengths[index_num].size (3 by default)]
@@ -116,6 +124,7 @@ void find_lis(deque<pair<uint32_t, uint32_t> > &a, vector<uint32_t> &b);
  *        return 'True' to indicate keep searching for more seed matches and better alignment.
  *		  return 'False' - stop search, the alignment is found
  * @param max_SW_score  the maximum SW score attainable for this read i.e. perfect match
+ * @param ws  scratch buffers of the calling Processor thread
  */
 void compute_lis_alignment(Read& read, Runopts& opts, Index& index, References& refs,
-                           Readstats& readstats, Refstats& refstats, bool& search, uint32_t max_SW_score);
\ No newline at end of file
+                           Readstats& readstats, Refstats& refstats, bool& search, uint32_t max_SW_score, Workspace& ws);
\ No newline at end of file
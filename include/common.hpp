@@ -35,6 +35,10 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <functional> // std::hash
+#include <utility> // std::pair
+#include <cstdint>
 #include <sstream>
 #include <iostream> // std::cout
 
@@ -114,6 +118,18 @@ static inline std::string fold_to_string(Args&&... args) {
     return ss.str();
 }
 
+/*
+ * 128 bit hash of a string: std::hash + FNV-1a. A key of the read sequences, see Dedup and ReadCache
+ */
+static inline std::pair<uint64_t, uint64_t> hash128(std::string_view str) {
+    uint64_t fnv = 14695981039346656037ULL;
+    for (auto c : str) {
+        fnv ^= static_cast<uint8_t>(c);
+        fnv *= 1099511628211ULL;
+    }
+    return { static_cast<uint64_t>(std::hash<std::string_view>()(str)), fnv };
+}
+
 /*
  * amount of memory that have been mapped into the process' address space
  * cat /proc/self/status | grep 'VmRSS:'
@@ -0,0 +1,109 @@
+/*
+@copyright 2016-2026 Clarity Genomics BVBA
+@copyright 2012-2016 Bonsai Bioinformatics Research Group
+@copyright 2014-2016 Knight Lab, Department of Pediatrics, UCSD, La Jolla
+
+@parblock
+SortMeRNA - next-generation reads filter for metatranscriptomic or total RNA
+
+This is a free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+SortMeRNA is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
+@endparblock
+
+@contributors Jenya Kopylova   jenya.kopylov@gmail.com
+              Laurent Noé      laurent.noe@lifl.fr
+              Pierre Pericard  pierre.pericard@lifl.fr
+              Daniel McDonald  wasade@gmail.com
+              Mikaël Salson    mikael.salson@lifl.fr
+              Hélène Touzet    helene.touzet@lifl.fr
+              Rob Knight       robknight@ucsd.edu
+              biocodz          biocodz@protonmail.com
+*/
+
+/**
+ * @file dedup.hpp
+ * @brief exact duplicate reads (OPT_DEDUP), aligned once per distinct sequence
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// forward
+class Readfeed;
+class Read;
+class KeyValueDatabase;
+struct Readstats;
+struct Runopts;
+
+/*
+ * A read and its reverse complement are the same sequence (canonical form: the smaller of the two 04 encoded strings).
+ * 'run' is a pre-pass over the reads that finds the representative of each distinct sequence i.e. its first read
+ * in the reads order (reads file, read number), so the choice does not depend on the threads.
+ * Only the representatives are aligned. The copies are skipped in the alignment (see 'is_copy') and their
+ * results are written to the KVDB from their representatives' after the alignment (see 'store_copies').
+ */
+class Dedup
+{
+public:
+	Dedup(Runopts& opts);
+
+	/* multi-threaded pre-pass over all the reads. Rewinds the 'readfeed' when done */
+	void run(Readfeed& readfeed);
+	/*
+	 * true if the read is a copy. Thread safe. With 'is_record' the copy is kept for 'store_copies'.
+	 * @param num_copies  OUT  the number of copies of a representative, which are counted in the Readstats
+	 *                         together with the representative i.e. when it is aligned for the first time
+	 */
+	bool is_copy(Read& read, bool is_record, uint32_t& num_copies);
+	/* write the results of the recorded copies to the KVDB. Logs the duplicate statistics */
+	void store_copies(KeyValueDatabase& kvdb, Readstats& readstats, double align_sec);
+
+private:
+	struct Key { uint64_t h1; uint64_t h2; }; // 128 bit hash of the canonical sequence
+	struct KeyHash { std::size_t operator()(const Key& key) const { return static_cast<std::size_t>(key.h1); } };
+	struct KeyEqual { bool operator()(const Key& a, const Key& b) const { return a.h1 == b.h1 && a.h2 == b.h2; } };
+	struct Entry
+	{
+		uint64_t rep; // representative: reads file << 48 | read number
+		bool rep_rc; // the representative is the reverse complement of the canonical sequence
+		uint32_t count; // number of reads with this sequence
+	};
+	struct Shard
+	{
+		std::mutex lock; // pre-pass only
+		std::unordered_map<Key, Entry, KeyHash, KeyEqual> map;
+	};
+	struct Copy
+	{
+		uint64_t read; // reads file << 48 | read number
+		uint64_t rep;
+		bool is_rc; // the copy is the reverse complement of its representative
+	};
+
+	Key canonical_key(Read& read, bool& is_rc);
+	void run_thread(int id, Readfeed& readfeed);
+
+	Runopts& opts;
+	std::vector<Shard> shards;
+	std::mutex copies_lock; // guards 'copies' and 'num_reads'
+	std::vector<Copy> copies;
+	uint64_t num_reads; // reads seen by the pre-pass
+	uint64_t num_distinct; // distinct sequences
+	double prepass_sec;
+}; // ~class Dedup
@@ -38,17 +38,53 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <vector>
+#include <string>
 #include <cstdint>
+#include <cstddef>
+
+#include "indexdb.hpp"
 
 // forward
 struct Runopts;
-struct kmer;
-struct kmer_origin;
 class Refstats;
 
+/**
+ * Decodes the positions of a single (L+1)-mer, one reference at a time e.g.
+ *
+ *   for (auto cur = index.positions(id); cur.next_ref(); )
+ *     while (cur.left > 0) pos = cur.next_pos(); // positions on the reference 'cur.seq'
+ */
+struct PositionsCursor {
+	const uint8_t* p;
+	const uint8_t* end;
+	uint32_t seq; // current reference
+	uint32_t count; // number of positions on the current reference
+	uint32_t left; // number of positions on the current reference not yet decoded
+	uint32_t pos; // last decoded position
+
+	PositionsCursor(const uint8_t* begin, const uint8_t* end) : p(begin), end(end), seq(0), count(0), left(0), pos(0) {}
+
+	/* move to the next reference skipping the positions not decoded. False if no more references */
+	bool next_ref() {
+		for (; left > 0; --left) get_varint(p);
+		if (p == end) return false;
+		seq += get_varint(p);
+		count = left = get_varint(p);
+		pos = 0;
+		return true;
+	}
+	uint32_t next_pos() {
+		--left;
+		return pos += get_varint(p);
+	}
+};
+
 /**
  * 1. Each reference file can be indexed into multiple index parts depending on the file size.
  *    Each index file name follows a pattern <Name_Part> e.g. index1_0, index1_1 etc.
+ * 2. An index part is a single flat file (see IndexHeader), which is mapped into memory
+ *    and used in place i.e. the tables below point into the mapping. If mapping fails,
+ *    the file is read into a single heap block. Either way Index::unload is O(1).
  */
 struct Index {
 	uint16_t index_num; // currrently loaded index number (DB file) Set in Main thread
@@ -62,15 +98,52 @@ struct Index {
 	//long _gap_open = 0; /* Smith-Waterman score for gap opening */
 	//long _gap_extension = 0; /* Smith-Waterman score for gap extension */
 
-	std::vector<kmer> lookup_tbl; /**< reference to L/2-mer look up table */
-	std::vector<kmer_origin> positions_tbl; /**< reference to (L+1)-mer positions table */
+	const FlatKmer* lookup_tbl; /**< L/2-mer look up table */
+	uint32_t lookup_tbl_size; /**< number of entries in the look up table */
+	const uint64_t* pos_dir; /**< (L+1)-mer positions directory: 'id' -> first byte of its positions in 'positions_tbl' */
+	const uint8_t* positions_tbl; /**< (L+1)-mer positions table, compact encoding (see write_index_part) */
+	const ExactKmer* exact_tbl; /**< exact L-mers table (see ExactKmer) */
+	uint32_t num_exact; /**< number of entries in the exact L-mers table */
 
 	/*
 	 * Initilize the index.
 	 * If index files do not exist or are empty - build the index.
 	 */
 	Index(Runopts & opts);
-	//~Index() {}
+	Index(); // empty index to be loaded later e.g. a prefetch buffer. Does not check or build the index files
+	~Index();
+	Index(const Index&) = delete;
+	Index& operator=(const Index&) = delete;
 	void load(uint32_t idx_num, uint32_t idx_part, std::vector<std::pair<std::string, std::string>>& indexfiles, Refstats & refstats);
 	void unload();
+	void prefault() const; // touch every page of the loaded part so that the search does not stall on page faults
+	std::size_t size() const { return map_size; } // bytes of the loaded part
+
+	/* forward/reverse mini-burst trie of the L/2-mer 'key' or NULL if none */
+	const FlatNodeElement* trie_F(uint32_t key) const {
+		return lookup_tbl[key].trie_F == 0 ? nullptr : reinterpret_cast<const FlatNodeElement*>(map_addr + lookup_tbl[key].trie_F);
+	}
+	const FlatNodeElement* trie_R(uint32_t key) const {
+		return lookup_tbl[key].trie_R == 0 ? nullptr : reinterpret_cast<const FlatNodeElement*>(map_addr + lookup_tbl[key].trie_R);
+	}
+	/* true if the L-mer of the L/2-mers 'key' and 'tail' is in the index. 'id' OUT its (L+1)-mer */
+	bool find_exact(uint32_t key, uint32_t tail, uint32_t& id) const {
+		const ExactKmer* first = exact_tbl + lookup_tbl[key].exact;
+		const ExactKmer* end = exact_tbl + (key + 1 < lookup_tbl_size ? lookup_tbl[key + 1].exact : num_exact);
+		for (const ExactKmer* last = end; first < last; ) {
+			const ExactKmer* mid = first + (last - first) / 2;
+			if (mid->tail < tail) first = mid + 1;
+			else last = mid;
+		}
+		if (first == end || first->tail != tail) return false;
+		id = first->id;
+		return true;
+	}
+	/* positions of the (L+1)-mer 'id' on the references */
+	PositionsCursor positions(uint32_t id) const { return PositionsCursor(positions_tbl + pos_dir[id], positions_tbl + pos_dir[id + 1]); }
+
+private:
+	const char* map_addr; // start of the mapped index file, or of the heap arena holding it
+	std::size_t map_size;
+	bool is_mapped; // false: the file was read into a heap arena (mmap failed)
 }; // ~struct Index
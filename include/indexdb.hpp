@@ -61,9 +61,32 @@ extern const char map_nt[122];
 #define THRESHOLD 128
 /**
  * parse each reference file (FASTA), and build the burst tries
+ * @param idx_to_build  indices into 'opts.indexfiles' of the references to index
  * @return void
  */
-int build_index(Runopts &opts);
+int build_index(Runopts &opts, const std::vector<std::size_t>& idx_to_build);
+
+/*
+ * Index descriptor '<index_prefix>.desc' records what the index of a reference file was
+ * built from: the content hash, the size and the modification time of the reference file,
+ * the indexing parameters and the index format version. It is written last, after all the other index files.
+ * An existing index is reused only if its descriptor equals the one of the current run.
+ * The reference file is only hashed when its modification time changed (see 'is_index_current').
+ */
+#define INDEX_DESC_SFX ".desc"
+
+/**
+ * @return the descriptor (text) of the index of the reference file 'ref_file' built with 'opts'
+ */
+std::string index_descriptor(const std::string& ref_file, Runopts& opts);
+
+/**
+ * compare the stored descriptor '<idx_prefix>.desc' with the reference file 'ref_file' and 'opts'.
+ * The content hash is only computed if the size and the parameters are the same, but the modification
+ * time is not e.g. the file was copied. The descriptor is then updated with the new time.
+ * @return true if the index can be reused
+ */
+bool is_index_current(const std::string& ref_file, const std::string& idx_prefix, Runopts& opts);
 
 struct NodeElement
 {
@@ -104,6 +127,99 @@ struct kmer
 	uint32_t count; // count of 9-mers
 };
 
+/*
+ * Flat index part layout ('<index_prefix>.idx_<part>.dat')
+ *
+ * The file is used as is after mmap in Index::load, so nothing in it is a pointer.
+ * All sections are 8-byte aligned:
+ *
+ *   IndexHeader
+ *   FlatKmer[1 << lnwin]             L/2-mer look-up table
+ *   uint64_t[number_elements + 1]    positions directory: positions of the (L+1)-mer 'id' are
+ *                                    encoded in the bytes [pos_dir[id] .. pos_dir[id+1]) of the
+ *                                    positions table
+ *   uint8_t[]                        positions table. The positions of an (L+1)-mer are sorted by
+ *                                    reference, then by position, and grouped by reference:
+ *                                      varint seq - previous seq (the first seq as is)
+ *                                      varint number of positions on the reference
+ *                                      varint pos - previous pos (the first pos as is) per position
+ *                                    Padded to 8 bytes.
+ *   ExactKmer[num_exact]             exact L-mers table, grouped by the first L/2-mer in the order of
+ *                                    the look-up table (see FlatKmer::exact), then sorted by the
+ *                                    second L/2-mer
+ *   mini-burst tries                 for each L/2-mer the forward then the reverse trie.
+ *                                    Each trie is laid out depth-first, in the order it is
+ *                                    traversed, so a search walks the file forward
+ */
+#define INDEX_MAGIC "SMR_IDX"
+#define INDEX_FORMAT_VERSION 3
+
+struct IndexHeader
+{
+	char magic[8];              // INDEX_MAGIC
+	uint32_t version;           // INDEX_FORMAT_VERSION
+	uint32_t lnwin;             // seed length L. The L/2-mer look-up table has (1 << lnwin) entries
+	uint32_t number_elements;   // number of unique (L+1)-mers
+	uint32_t max_positions;     // max number of positions of a single (L+1)-mer
+	uint64_t num_positions;     // total number of positions in the positions table
+	uint64_t lookup_tbl_offset; // offsets (bytes) of the sections from the start of the file
+	uint64_t pos_dir_offset;
+	uint64_t positions_offset;
+	uint64_t exact_offset;
+	uint64_t tries_offset;
+	uint64_t file_size;
+	uint64_t num_exact;         // number of exact L-mers
+};
+
+// node element of a flat mini-burst trie
+struct FlatNodeElement
+{
+	// offset (bytes) of the child trie node or the bucket relative to this node element.
+	// Children are always written after their parent, so the offset is positive.
+	uint32_t offset;
+	uint32_t size; // size (bytes) of bucket
+	uint32_t flag; // 0 :: empty, 1 :: trie node, 2 :: bucket
+};
+
+// flat L/2-mer look-up table entry
+struct FlatKmer
+{
+	uint64_t trie_F; // offset of the forward mini burst trie from the start of the file, 0 if none
+	uint64_t trie_R; // offset of the reverse mini burst trie from the start of the file, 0 if none
+	uint32_t count; // count of 9-mers
+	uint32_t exact; // first exact L-mer of this L/2-mer in the exact L-mers table. The last is before the next L/2-mer's first
+};
+
+/*
+ * exact L-mer: the first L of an (L+1)-mer of the forward mini-burst trie of its first L/2-mer.
+ * Only the first (L+1)-mer of each L-mer in the trie traversal order is kept, which is
+ * the one the search stops at on an exact match (see 'TrieTraversal::scan_bucket')
+ */
+struct ExactKmer
+{
+	uint32_t tail; // second L/2-mer, 2 bits per nt, the first nt in the highest bits (see 'Read::hashKmers')
+	uint32_t id; // (L+1)-mer id i.e. index into the positions directory
+};
+
+// LEB128 variable length unsigned integer used in the positions table
+inline void put_varint(std::vector<uint8_t>& buf, uint32_t val)
+{
+	while (val >= 0x80)
+	{
+		buf.push_back(static_cast<uint8_t>(val | 0x80));
+		val >>= 7;
+	}
+	buf.push_back(static_cast<uint8_t>(val));
+}
+
+inline uint32_t get_varint(const uint8_t*& p)
+{
+	uint32_t val = *p & 0x7F;
+	for (int shift = 7; *p++ & 0x80; shift += 7)
+		val |= static_cast<uint32_t>(*p & 0x7F) << shift;
+	return val;
+}
+
 // data structure to store information on index parts
 // i.e. index can be partitioned for large reference files
 struct index_parts_stats {
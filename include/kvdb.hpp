@@ -37,19 +37,111 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
-#include "rocksdb/db.h"
-#include "rocksdb/slice.h"
-#include "rocksdb/options.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
+// forward
+struct Runopts;
+
+// flush thresholds of KvdbBatch
+#define KVDB_BATCH_COUNT 1024 // records
+#define KVDB_BATCH_BYTES (1 << 20) // keys + values
+
+// estimated memory (bytes) of a read's results in the in-memory store: key, value header and hash map node,
+// and per alignment. Used to decide if the results fit in memory, see 'kvdb_type'
+#define KVDB_MEM_READ_BYTES 160
+#define KVDB_MEM_ALIGN_BYTES 128
+
+enum class KvdbType { rocksdb, memory };
+
+/*
+ * storage of the records behind KeyValueDatabase
+ */
+class KvStore {
+public:
+	virtual ~KvStore() {}
+	virtual void put(const std::string& key, const std::string& val) = 0;
+	/* all the records in a single write. May move from the records */
+	virtual void write(std::vector<std::pair<std::string, std::string>>& records) = 0;
+	virtual std::string get(const std::string& key) = 0; // empty if not found
+	/* calls 'fn' with the value in place, without a copy. False if not found */
+	virtual bool view(const std::string& key, const std::function<void(std::string_view)>& fn) = 0;
+
+	class Cursor {
+	public:
+		virtual ~Cursor() {}
+		virtual bool view(const std::string& key, const std::function<void(std::string_view)>& fn) = 0;
+	};
+	virtual std::unique_ptr<Cursor> cursor() = 0;
+};
+
+/*
+ * The alignment results of the reads (and the Readstats) keyed by the read id.
+ * Stored in RocksDB in the 'kvdbdir', or only in memory when nothing reads them after this run (see 'kvdb_type')
+ */
 class KeyValueDatabase {
 public:
-	KeyValueDatabase(std::string const &kvdbPath);
-	~KeyValueDatabase() { delete kvdb; }
+	/* @param is_wal  RocksDB writes the write-ahead log. Without it a crash loses the writes not yet flushed to the DB files */
+	KeyValueDatabase(std::string const &kvdbPath, KvdbType type = KvdbType::rocksdb, bool is_wal = true);
 
-	void put(std::string key, std::string val);
-	std::string get(std::string key);
+	void put(std::string key, std::string val) { store->put(key, val); }
+	void write(std::vector<std::pair<std::string, std::string>>& records) { store->write(records); }
+	std::string get(std::string key) { return store->get(key); }
+	bool view(const std::string& key, const std::function<void(std::string_view)>& fn) { return store->view(key, fn); }
+	std::unique_ptr<KvStore::Cursor> cursor() { return store->cursor(); }
 	int clear(std::string dbPath);
 private:
-	rocksdb::DB* kvdb;
-	rocksdb::Options options;
+	std::unique_ptr<KvStore> store;
+};
+
+/*
+ * The in-memory store is used for a full run ('-task 4') into an empty KVDB dir
+ * (nothing reads the results after the run) if the estimated size of the results fits into
+ * a half of the available memory. Otherwise RocksDB, also with OPT_KVDB_DISK
+ * @param num_reads  number of all the reads
+ */
+KvdbType kvdb_type(uint64_t num_reads, Runopts& opts);
+
+/*
+ * Write buffer of a single thread. The records are written to the DB in batches, so that the threads
+ * do not line up on the DB write path (WAL, memtable, locks) for every record.
+ * The records are not visible to 'KeyValueDatabase::get' until flushed. Flushes on destruction.
+ */
+class KvdbBatch {
+public:
+	KvdbBatch(KeyValueDatabase& kvdb) : kvdb(kvdb), bytes(0) {}
+	~KvdbBatch() { flush(); }
+	KvdbBatch(const KvdbBatch&) = delete;
+	KvdbBatch& operator=(const KvdbBatch&) = delete;
+
+	void put(const std::string& key, const std::string& val); // flushes when the batch is full
+	void flush();
+private:
+	KeyValueDatabase& kvdb;
+	std::vector<std::pair<std::string, std::string>> records;
+	std::size_t bytes; // keys + values
+};
+
+/*
+ * Sequential reader of a single thread. Reading the keys in the increasing order is a forward scan of the DB
+ * rather than a point lookup per key. A key lower than the previous one is looked up (seek).
+ * Sees the records written before its first 'get'.
+ */
+class KvdbCursor {
+public:
+	KvdbCursor(KeyValueDatabase& kvdb) : kvdb(kvdb) {}
+
+	bool view(const std::string& key, const std::function<void(std::string_view)>& fn)
+	{
+		if (!cursor) cursor = kvdb.cursor();
+		return cursor->view(key, fn);
+	}
+private:
+	KeyValueDatabase& kvdb;
+	std::unique_ptr<KvStore::Cursor> cursor;
 };
@@ -120,7 +120,14 @@ OPT_ALIGN = "align",  // TODO: on hold
 OPT_FILTER = "filter",  // TODO: on hold
 OPT_DBG_LEVEL = "dbg-level",
 OPT_MAX_READ_LEN = "max_read_len",
-OPT_SCORE_SPLIT = "score_split";
+OPT_SCORE_SPLIT = "score_split",
+OPT_READS_MAJOR = "reads_major",
+OPT_BAND = "band",
+OPT_XDROP_LOSSY = "xdrop_lossy",
+OPT_DEDUP = "dedup",
+OPT_READ_CACHE = "read_cache",
+OPT_NO_WAL = "no_wal",
+OPT_KVDB_DISK = "kvdb_disk";
 
 // help strings
 const std::string \
@@ -375,7 +382,9 @@ help_interval =
 	"                                            the reference database e.g. '-interval 2'.\n",
 help_m = 
 	"Indexing: the amount of memory (in Mbytes) for          3072\n"
-	"                                            building the index.\n",
+	"                                            building the index. Alignment\n"
+	"                                            uses it to decide on loading the\n"
+	"                                            next index part in background.\n",
 
 help_L = 
 	"Indexing: seed length.                                  18\n",
@@ -401,7 +410,8 @@ help_zip_out =
 help_index =
     "Build reference database index                          1\n\n"
 	"       By default when this option is not used, the program checks the reference index and\n"
-	"       builds it if not already existing.\n"
+	"       builds it if not already existing, or re-builds it if the reference file or the indexing\n"
+	"       parameters changed since it was built (see '<index>.desc').\n"
 	"       This can be changed by using '-" + OPT_INDEX + "' as follows:\n"
 	"       '-" + OPT_INDEX + " 0' - skip indexing. If the index does not exist, the program will terminate\n"
 	"                                and warn to build the index prior performing the alignment\n"
@@ -420,7 +430,43 @@ help_score_split =
 	"Calculate minimal SW score per split rather than        False\n"
     "                                            all reads. This has an effect similar to increasing\n"
     "                                            e-value i.e. lowers the filtering threshold to less\n"
-    "                                            sensitive (see issue 453)\n"
+    "                                            sensitive (see issue 453)\n",
+help_reads_major = 
+	"Load all the index parts into memory and search         False\n"
+	"                                            each read against all of them in a single pass\n"
+	"                                            over the reads. Used only if all the parts fit\n"
+	"                                            into the memory limit '-m'\n",
+help_band = 
+	"Banded SW alignment: align only within INT diagonals    0\n"
+	"                                            around the diagonals of the LIS seeds. The full\n"
+	"                                            SW is used if the banded score is below the minimal\n"
+	"                                            score. 0 - full SW only\n",
+help_xdrop_lossy = 
+	"Lossy heuristic: skip the SW of a window if the         0\n"
+	"                                            ungapped X-drop extensions of the LIS seeds along\n"
+	"                                            their diagonals (stopping when the score drops INT\n"
+	"                                            below the best) sum up below the minimal score.\n"
+	"                                            Not a bound of the gapped SW score, the alignments\n"
+	"                                            with gaps near the seeds can be missed. 0 - off\n",
+help_dedup = 
+	"Align exact duplicate reads once. A read and its        False\n"
+	"                                            reverse complement are duplicates. The results of\n"
+	"                                            the first read of a sequence are reused for the\n"
+	"                                            other copies\n",
+help_read_cache = 
+	"Cache of the read search results shared by the          0\n"
+	"                                            threads: max number of the cached results. A read\n"
+	"                                            repeated with the same sequence and strand is\n"
+	"                                            searched once per index part. 0 - off\n",
+help_no_wal = 
+	"Do not write the key-value DB write-ahead log. Faster   False\n"
+	"                                            result writes. The results of a crashed run are\n"
+	"                                            lost and have to be aligned again\n",
+help_kvdb_disk = 
+	"Always store the results in the key-value DB on disk.   False\n"
+	"                                            By default a full run keeps the results in memory\n"
+	"                                            when their estimated size fits in a half of the\n"
+	"                                            available memory\n"
 //help_align =
 //    "Perform the alignment                                   False\n\n"
 //	"       Search a single best alignment per read\n\n",
@@ -521,6 +567,11 @@ public:
 	bool is_align = false;
 	bool is_filter = false;
     bool is_score_split = false;  // if true - calculate the SW score per split rather then for all reads
+	bool is_reads_major = false; // OPT_READS_MAJOR all index parts resident, single pass over the reads
+	bool is_dedup = false; // OPT_DEDUP align the duplicate reads once
+	uint32_t read_cache = 0; // OPT_READ_CACHE max number of the cached read search results. 0 - no cache
+	bool is_no_wal = false; // OPT_NO_WAL no write-ahead log in the key-value DB
+	bool is_kvdb_disk = false; // OPT_KVDB_DISK always RocksDB, no in-memory key-value DB
 
 	// Option derived Flags
 	bool is_as_percent = false; // derived from OPT_EDGES
@@ -568,6 +619,8 @@ public:
 	int32_t num_seeds = 2; // min number of seeds on a read that have matches in DB prior calculating LIS
 	int32_t min_lis = 2; // search all alignments that have LIS >= min_lis
 	int32_t edges = -1; // OPT_EDGES
+	int32_t band = 0; // OPT_BAND margin added to each side of the LIS diagonals. 0 - no banded alignment
+	int32_t xdrop_lossy = 0; // OPT_XDROP_LOSSY score drop ending an ungapped seed extension. 0 - no X-drop heuristic
 
 	uint32_t minoccur = 0; // TODO: add to cmd options. Min number of k-mer occurrences in the DB to use for matching. See 'index.lookup_tbl[kmer_idx].count'
 
@@ -681,6 +734,13 @@ private:
 	void opt_max_pos(const std::string &val);
 	void opt_readfeed(const std::string& val);
 	void opt_score_split(const std::string& val);
+	void opt_reads_major(const std::string& val);
+	void opt_band(const std::string& val);
+	void opt_xdrop_lossy(const std::string& val);
+	void opt_dedup(const std::string& val);
+	void opt_read_cache(const std::string& val);
+	void opt_no_wal(const std::string& val);
+	void opt_kvdb_disk(const std::string& val);
 	/*
 	 * true: 1,yes,Yes,Y,y,T,t, false: 0,No,NO,no,N,n,F,f
 	*/
@@ -715,7 +775,7 @@ private:
 	std::multimap<std::string, std::string> mopt;
 
 	// OPTIONS Map - specifies all possible options
-	const std::array<opt_6_tuple, 56> options = {
+	const std::array<opt_6_tuple, 63> options = {
 		std::make_tuple(OPT_REF,            "PATH",        COMMON,      true,  help_ref, &Runopts::opt_ref),
 		std::make_tuple(OPT_READS,          "PATH",        COMMON,      true,  help_reads, &Runopts::opt_reads),
 		//std::make_tuple(OPT_ALIGN,          "BOOL",        COMMON,      true,  help_align, &Runopts::opt_align),
@@ -757,8 +817,15 @@ private:
 		std::make_tuple(OPT_OTU_MAP,        "BOOL",        OTU_PICKING, false, help_otu_map, &Runopts::opt_otu_map),
 		std::make_tuple(OPT_PASSES,         "INT,INT,INT", ADVANCED,    false, help_passes, &Runopts::opt_passes),
 		std::make_tuple(OPT_EDGES,          "INT",         ADVANCED,    false, help_edges, &Runopts::opt_edges),
+		std::make_tuple(OPT_BAND,           "INT",         ADVANCED,    false, help_band, &Runopts::opt_band),
+		std::make_tuple(OPT_XDROP_LOSSY,    "INT",         ADVANCED,    false, help_xdrop_lossy, &Runopts::opt_xdrop_lossy),
 		std::make_tuple(OPT_NUM_SEEDS,      "BOOL",        ADVANCED,    false, help_num_seeds, &Runopts::opt_num_seeds),
 		std::make_tuple(OPT_FULL_SEARCH,    "INT",         ADVANCED,    false, help_full_search, &Runopts::opt_full_search),
+		std::make_tuple(OPT_READS_MAJOR,    "BOOL",        ADVANCED,    false, help_reads_major, &Runopts::opt_reads_major),
+		std::make_tuple(OPT_DEDUP,          "BOOL",        ADVANCED,    false, help_dedup, &Runopts::opt_dedup),
+		std::make_tuple(OPT_READ_CACHE,     "INT",         ADVANCED,    false, help_read_cache, &Runopts::opt_read_cache),
+		std::make_tuple(OPT_NO_WAL,         "BOOL",        ADVANCED,    false, help_no_wal, &Runopts::opt_no_wal),
+		std::make_tuple(OPT_KVDB_DISK,      "BOOL",        ADVANCED,    false, help_kvdb_disk, &Runopts::opt_kvdb_disk),
 		std::make_tuple(OPT_PID,            "BOOL",        ADVANCED,    false, help_pid, &Runopts::opt_pid),
 		std::make_tuple(OPT_A,              "INT",         ADVANCED,    false, help_a, &Runopts::opt_a),
 		std::make_tuple(OPT_THREADS,        "INT",         ADVANCED,    false, help_threads, &Runopts::opt_threads),
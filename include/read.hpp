@@ -39,6 +39,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <vector>
 #include <algorithm> // std::find_if
@@ -49,6 +50,9 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include "ssw.hpp" // s_align2
 #include "options.hpp"
 
+// first byte of a version 1 record, see 'Read::toBinString'. The legacy records start with the low byte of 'lastIndex'
+#define READ_REC_V1 0xF1
+
 class References; // forward
 
 struct alignment_struct2
@@ -149,15 +153,39 @@ public:
 	/* convert to Json string to store in DB */
 	// std::string matchesToJson();
 	void unmarshallJson(KeyValueDatabase& kvdb);
-	/* serialize to binary string to store in DB */
+	/*
+	 * serialize to binary string to store in DB. Version 1 record: varints (LEB128), the signed values zigzag coded
+	 *   READ_REC_V1 | lastIndex | lastPart | c_yid_ycov | n_yid_ncov | n_nid_ycov | n_denovo
+	 *   | flags: is_done, is_hit << 1, null_align_output << 2 (1 byte) | max_SW_count | num_alignments | hit_seeds
+	 *   | alignment.min_index | alignment.max_index | number of alignments | alignments
+	 * an alignment:
+	 *   index_num | part | ref_num | ref_begin1 | ref_end1 - ref_begin1 | read_begin1 | read_end1 - read_begin1
+	 *   | readlen | score1 | strand (1 byte) | cigar size | cigar
+	 * Empty if the read has no alignments
+	 */
 	std::string toBinString(); 
 	bool load_db(KeyValueDatabase& kvdb);
+	bool load_db(KvdbCursor& cursor); // the reads in the file order, see 'KvdbCursor'
+	/* key of the read in the key-value DB */
+	std::string key() const { return db_key(readfile_idx, read_num); }
+	/*
+	 * 8 bytes big-endian 'readfile_idx << 48 | read_num' so that the keys sort in the order of the reads.
+	 * Never equal to the key of the Readstats, a decimal hash of the reads file names (see 'Readstats::dbkey')
+	 */
+	static std::string db_key(uint64_t readfile_idx, uint64_t read_num);
+	/*
+	 * restore from 'toBinString' or from a legacy record. The read is left as is if the record is corrupt
+	 * @param is_fatal  exit on a corrupt record, otherwise return false
+	 */
+	bool fromBinString(std::string_view bstr, bool is_fatal = true);
 	void seqToIntStr();
 	void revIntStr();
 	/* convert isequence to alphabetic form i.e. to A,C,G,T,N */
 	std::string get04alphaSeq();
 	/* flip isequence between 03 - 04 alphabets */
 	void flip34();
+	/* isequence in 04 alphabet (same strand), without flipping the read */
+	std::string get04Seq();
 
 	/*
 	* count mismatches, gaps, matches, and calculate %ID, %COV given an alignment
@@ -169,5 +197,10 @@ public:
 
 	std::string getSeqId();
 	uint32_t hashKmer(uint32_t pos, uint32_t len);
+	/* rolling hash of all the k-mers of length 'len' i.e. hashes[pos] == hashKmer(pos, len) */
+	void hashKmers(uint32_t len, std::vector<uint32_t>& hashes);
 	bool from_string(std::string& readstr);
+private:
+	bool fromBinStringV1(std::string_view bstr); // false if not a valid READ_REC_V1 record
+	bool fromBinStringV0(std::string_view bstr); // legacy record
 }; // ~class Read
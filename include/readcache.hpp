@@ -0,0 +1,95 @@
+/*
+@copyright 2016-2026 Clarity Genomics BVBA
+@copyright 2012-2016 Bonsai Bioinformatics Research Group
+@copyright 2014-2016 Knight Lab, Department of Pediatrics, UCSD, La Jolla
+
+@parblock
+SortMeRNA - next-generation reads filter for metatranscriptomic or total RNA
+
+This is a free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+SortMeRNA is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
+@endparblock
+
+@contributors Jenya Kopylova   jenya.kopylov@gmail.com
+              Laurent Noé      laurent.noe@lifl.fr
+              Pierre Pericard  pierre.pericard@lifl.fr
+              Daniel McDonald  wasade@gmail.com
+              Mikaël Salson    mikael.salson@lifl.fr
+              Hélène Touzet    helene.touzet@lifl.fr
+              Rob Knight       robknight@ucsd.edu
+              biocodz          biocodz@protonmail.com
+*/
+
+/**
+ * @file readcache.hpp
+ * @brief results of the read search shared between the Processor threads (OPT_READ_CACHE)
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// forward
+class Read;
+
+/*
+ * Bounded LRU cache of the read search results. A repeated read (same sequence, same strand) searched
+ * against the same index part, starting from the same alignment state, gets the same result, so it can
+ * be copied instead of searched again.
+ * The key is a 128 bit hash of the read sequence, the index part and the read state before the search
+ * i.e. the 'Read::toBinString'. The cache is split into independently locked shards.
+ */
+class ReadCache
+{
+public:
+	struct Key { uint64_t h1; uint64_t h2; };
+	struct Value
+	{
+		std::string bstr; // 'Read::toBinString' after the search. Only set if 'is_new_hit'
+		bool is_new_hit; // the search added or replaced an alignment
+		bool is_first_hit; // the read was aligned for the first time i.e. counted in the Readstats
+	};
+
+	/* @param capacity  max number of the cached results */
+	ReadCache(uint32_t capacity);
+
+	/* key of the read search. 'bstr' is the read state before the search */
+	static Key make_key(Read& read, const std::string& bstr, uint16_t index_num, uint16_t part);
+	/* thread safe. On a hit, copies the value and marks it most recently used */
+	bool get(const Key& key, Value& value);
+	/* thread safe. Evicts the least recently used value of the shard when full */
+	void put(const Key& key, const Value& value);
+	/* drop all the values e.g. when the next index part is loaded */
+	void clear();
+
+private:
+	struct KeyHash { std::size_t operator()(const Key& key) const { return static_cast<std::size_t>(key.h1); } };
+	struct KeyEqual { bool operator()(const Key& a, const Key& b) const { return a.h1 == b.h1 && a.h2 == b.h2; } };
+	struct Shard
+	{
+		std::mutex lock;
+		std::list<std::pair<Key, Value>> lru; // most recently used first
+		std::unordered_map<Key, std::list<std::pair<Key, Value>>::iterator, KeyHash, KeyEqual> map;
+	};
+
+	Shard& shard(const Key& key) { return shards[key.h2 % shards.size()]; }
+
+	std::vector<Shard> shards;
+	std::size_t shard_capacity; // max number of values per shard
+}; // ~class ReadCache
@@ -84,6 +84,10 @@ struct Readstats
 	std::vector<uint64_t> reads_matched_per_db; // [3] reads matched per database.
     //              |_TODO: should be atomic std::atomic<uint64_t> 20201019
 
+	// per read stream ('Read::readfile_idx'): bit 'Read::read_num' is set if the read has results in the KVDB.
+	// A stream is written only by the thread that reads it. No streams - not known, all the reads are looked up
+	std::vector<std::vector<uint64_t>> hits;
+
 	bool is_stats_calc; // flags 'computeStats' was called.
 	bool is_set_aligned_id_cov; // flag 'total_aligned_id_cov' was calculated (so no need to calculate no more)
 
@@ -95,4 +99,7 @@ struct Readstats
 	bool restoreFromDb(KeyValueDatabase & kvdb);
 	void store_to_db(KeyValueDatabase & kvdb);
 	void set_is_set_aligned_id_cov();
+	void init_hits(std::size_t num_streams);
+	void set_hit(uint64_t stream, uint64_t read_num);
+	bool is_stored(uint64_t stream, uint64_t read_num) const; // false if the read has no results in the KVDB
 }; // ~struct Readstats
@@ -47,6 +47,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 
 #include "bitvector.hpp"
 #include "options.hpp"
+#include "indexdb.hpp"
 
 
 /* 
@@ -89,6 +90,18 @@ struct id_win
 	}
 };
 
+/* child trie node of a flat node element (flag == 1) */
+inline const FlatNodeElement* flat_child(const FlatNodeElement* node)
+{
+	return reinterpret_cast<const FlatNodeElement*>(reinterpret_cast<const char*>(node) + node->offset);
+}
+
+/* start of the bucket of a flat node element (flag == 2) */
+inline const unsigned char* flat_bucket(const FlatNodeElement* node)
+{
+	return reinterpret_cast<const unsigned char*>(node) + node->offset;
+}
+
 /*! @fn traversetrie_align()
 	@brief
 	given a k-mer (seed/window position - 'win_num') on the read, search for matching k-mers on references using the reference index.
@@ -104,7 +117,7 @@ struct id_win
 		pattern = |------ [p_1] ------|------ [p_2] --....--|<br/>
 				  |------ trie -------|----- tail ----....--|<br/>
 
-	@param  NodeElement*     trie_t                  root node to mini burst trie
+	@param  FlatNodeElement* trie_t                  root node to mini burst trie
 	@param  uint32_t         lev_t                   initial Levenshtein automaton state
 	@param  unsigned char    depth                   trie node depth
 	@param  MYBITSET*        win_k1_ptr              pointer to start of forward L/2-mer bitvector
@@ -116,7 +129,7 @@ struct id_win
 	@return void
 */
 void traversetrie_align(
-	NodeElement* trie_t,
+	const FlatNodeElement* trie_t,
 	uint32_t lev_t,
 	unsigned char depth,
 	UCHAR* win_k1_ptr,
@@ -126,4 +139,53 @@ void traversetrie_align(
 	uint32_t win_num,
 	uint32_t partialwin,
 	Runopts& opts
-);
\ No newline at end of file
+);
+
+// number of trie traversals (read windows) interleaved by traversetrie_align_batch
+#define TRAVERSAL_BATCH 16
+
+/*! @brief A resumable (explicit stack) traversal of a single mini-burst trie.
+
+	Performs the same search as the recursive traversetrie_align, but one trie hop per 'step'.
+	Before returning, 'step' prefetches the trie node or bucket it is going to read next,
+	so that a batch of traversals can be interleaved (see traversetrie_align_batch) and
+	the cache misses of the in-flight traversals overlap.
+*/
+struct TrieTraversal
+{
+	// IN
+	UCHAR* win_k1_ptr; // pointer to start of the L/2-mer bitvector
+	UCHAR* win_k1_full; // pointer to start of structure storing all bitvectors
+	uint32_t win_num; // k-mer (seed/window position) on the read
+	uint32_t partialwin;
+	// OUT
+	bool accept_zero_kmer; // a 0-error match was found
+	std::vector<id_win> id_hits; // IDs of all candidate L-mers
+	bool is_done;
+
+	/* start the traversal at the root 'trie_t'. Keeps 'id_hits' and 'accept_zero_kmer' */
+	void start(const FlatNodeElement* trie_t, UCHAR* k1_ptr, UCHAR* k1_full, uint32_t win, uint32_t pwin, uint32_t lev_t = 0, uint32_t depth = 0);
+	/* run until the next trie node or bucket has to be read. Sets 'is_done' at the end of the traversal */
+	void step(Runopts& opts);
+
+private:
+	struct Frame
+	{
+		const FlatNodeElement* node; // trie node i.e. 4 node elements
+		uint32_t lev_pivot; // Levenshtein automaton state on entering the node
+		uint32_t depth;
+		uint32_t next; // next node element to visit
+	};
+	Frame stack[32]; // trie depth is at most 'partialwin'
+	int top;
+	const FlatNodeElement* bucket; // bucket node element to scan on the next step or NULL
+	uint32_t bucket_lev;
+	uint32_t bucket_depth;
+
+	bool scan_bucket(Runopts& opts); // true if a 0-error match stops the search
+};
+
+/*! @fn traversetrie_align_batch()
+	@brief interleave the traversals 'trav[0..n)' until all of them are done
+*/
+void traversetrie_align_batch(TrieTraversal* trav, std::size_t n, Runopts& opts);
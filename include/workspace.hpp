@@ -0,0 +1,130 @@
+/*
+@copyright 2016-2026 Clarity Genomics BVBA
+@copyright 2012-2016 Bonsai Bioinformatics Research Group
+@copyright 2014-2016 Knight Lab, Department of Pediatrics, UCSD, La Jolla
+
+@parblock
+SortMeRNA - next-generation reads filter for metatranscriptomic or total RNA
+
+This is a free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+SortMeRNA is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
+@endparblock
+
+@contributors Jenya Kopylova   jenya.kopylov@gmail.com
+              Laurent Noé      laurent.noe@lifl.fr
+              Pierre Pericard  pierre.pericard@lifl.fr
+              Daniel McDonald  wasade@gmail.com
+              Mikaël Salson    mikael.salson@lifl.fr
+              Hélène Touzet    helene.touzet@lifl.fr
+              Rob Knight       robknight@ucsd.edu
+              biocodz          biocodz@protonmail.com
+*/
+
+/**
+ * @file workspace.hpp
+ * @brief per-thread scratch buffers for the read search i.e. traverse -> compute_lis_alignment
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility> // std::pair
+
+#include "traverse_bursttrie.hpp"
+
+// forward
+struct Runopts;
+
+/* the first SW window of a candidate reference, scored ahead in a batch (see 'compute_lis_alignment') */
+struct SwJob
+{
+	bool is_set = false; // the candidate has a window to align
+	uint32_t que_start = 0; // read slice
+	uint32_t qlen = 0;
+	uint32_t ref_start = 0; // reference window
+	uint32_t rlen = 0;
+	int score = -1; // SW score of the window
+};
+
+/* an alignment in 'read.alignment.alignv' that has a score and end positions, but no CIGAR yet (see 'compute_lis_alignment') */
+struct SwTrace
+{
+	uint32_t idx = 0; // index in 'alignv'
+	int32_t que_offset = 0; // read slice
+	int qlen = 0;
+	int32_t ref_offset = 0; // reference window
+	int rlen = 0;
+};
+
+struct parasail_matrix;
+struct parasail_profile;
+
+/*
+ * Scratch memory owned by a Processor thread (see align2) and passed down to 'traverse'
+ * and 'compute_lis_alignment'. The buffers are cleared, never freed, between the reads,
+ * so once they have grown to the largest read seen, the search does not touch the heap.
+ */
+struct Workspace
+{
+	// traverse
+	std::vector<bool> read_pos_searched; // windows (read positions) already searched in the trie
+	std::vector<UCHAR> bitvec; // window (prefix/suffix) bitvectors, one per traversal in a batch
+	std::vector<TrieTraversal> trav; // TRAVERSAL_BATCH interleaved trie traversals
+	std::vector<uint32_t> batch_pos; // positions of the windows to search in the current Pass
+	std::vector<uint32_t> kmer_hash; // hashes of the half windows (partialwin-mers) on the read, see 'Read::hashKmers'
+	std::vector<id_win> win_hits; // lent to 'read.id_win_hits' for the time of the search
+
+	// compute_lis_alignment
+	std::vector<std::pair<uint32_t, uint32_t>> ref_hits; // [ref, num k-mer hits] unsorted, one entry per reference hit
+	std::vector<uint32_t> ref_slot; // reference -> its entry in 'ref_hits'. UINT32_MAX if none i.e. reset after each read
+	std::vector<uint32_t> ref_fill; // per 'ref_hits' entry: next free position in 'cand_hits' or UINT32_MAX if not a candidate
+	std::vector<std::pair<uint32_t, uint32_t>> refs_kmer_count; // [ref, num k-mer hits] the candidate references
+	std::vector<std::pair<uint32_t, uint32_t>> cand_hits; // [pos on ref, pos on read] k-mer hits grouped by candidate
+	std::vector<std::size_t> cand_hits_pos; // start of each candidate's hits in 'cand_hits' + the end
+	std::vector<SwJob> sw_jobs; // first SW window of each candidate of the batch
+	std::size_t batch_first; // first candidate of the batch
+	std::string query04; // the read in 0..4 encoding for the batch scoring
+	std::vector<int16_t> batch_q; // batch scoring: query nucleotides [query pos][lane]
+	std::vector<int16_t> batch_r; // batch scoring: reference nucleotides [reference pos][lane]
+	std::vector<int16_t> batch_h; // batch scoring: H scores of the previous row [reference pos][lane]
+	std::vector<int16_t> batch_f; // batch scoring: F scores of the previous row [reference pos][lane]
+	std::vector<std::pair<uint32_t, uint32_t>> match_set; // sliding window over 'hits_on_ref'. Front is at 'match_head'
+	std::size_t match_head;
+	std::vector<uint32_t> lis_arr; // indices into the 'match_set' of the matches comprising the LIS
+	std::vector<uint32_t> lis_prev; // find_lis predecessor links
+	std::vector<int> band_h; // banded SW: two rows of H scores
+	std::vector<int> band_f; // banded SW: two rows of F (vertical gap) scores
+	std::vector<uint8_t> band_trace; // banded SW: traceback bits of the band cells
+	std::vector<SwTrace> sw_traces; // alignments kept in 'alignv' waiting for the traceback
+	uint64_t num_xdrop = 0; // SW windows checked by the lossy X-drop heuristic (OPT_XDROP_LOSSY)
+	uint64_t num_xdrop_skipped = 0; // SW windows skipped unscored by the X-drop heuristic
+	parasail_matrix* matrix; // scoring matrix, built once from the Run options
+	parasail_profile* profile; // query profile of 'profile_seq'
+	std::string profile_seq; // the query (integer encoded read slice) the 'profile' was built for
+
+	Workspace(Runopts& opts);
+	~Workspace();
+	Workspace(const Workspace&) = delete;
+	Workspace& operator=(const Workspace&) = delete;
+
+	/* parasail profile of the integer encoded query 'seq[0..len)'. Only rebuilt when the query changes */
+	parasail_profile* query_profile(const char* seq, int len);
+};
+
+#ifdef SMR_ALLOC_COUNTER
+/* number of the heap allocations (operator new) made so far by the calling thread */
+uint64_t thread_alloc_count();
+#endif
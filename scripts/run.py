@@ -1495,49 +1495,37 @@ def _parse_stats_binary(fpath: Path):
     return stats, fasta_filename
 
 
-def _parse_kmer_binary(fpath: Path) -> dict:
+def _parse_idx_binary(fpath: Path) -> tuple:
     '''
-    Parse *.kmer_N.dat: (1 << seed_win_len) consecutive uint32_t kmer counts.
+    Parse *.idx_N.dat (see IndexHeader in include/indexdb.hpp):
+      char     magic[8]
+      uint32_t version, lnwin, number_elements, max_positions
+      uint64_t num_positions, lookup_tbl_offset, pos_dir_offset, positions_offset, tries_offset, file_size
+      FlatKmer[1 << lnwin]  (uint64_t trie_F, uint64_t trie_R, uint32_t count, uint32_t reserved = 24 bytes each)
+    Returns (kmer, pos) stats dicts.
     '''
-    data = fpath.read_bytes()
-    n = len(data) // 4
-    counts = struct.unpack(f'<{n}I', data)
-    return {
+    with open(fpath, 'rb') as f:
+        hdr = f.read(72)
+        if len(hdr) < 72:
+            return {}, {}
+        _, lnwin, num_elements, max_positions = struct.unpack('<4I', hdr[8:24])
+        num_positions, lookup_off, _, positions_off, tries_off = struct.unpack('<5Q', hdr[24:64])
+        f.seek(lookup_off)
+        n = 1 << lnwin
+        counts = [c for (_, _, c, _) in struct.iter_unpack('<QQII', f.read(n * 24))]
+    kmer = {
         'num_nonzero': sum(1 for c in counts if c > 0),
         'total_count': sum(counts),
         'max_count':   max(counts) if counts else 0,
     }
-
-
-def _parse_pos_binary(fpath: Path) -> dict:
-    '''
-    Parse *.pos_N.dat:
-      uint32_t number_elements
-      for each element:
-        uint32_t size
-        seq_pos[size]  (seq_pos = {uint32_t pos, uint32_t seq} = 8 bytes each)
-    '''
-    total_positions = 0
-    max_positions   = 0
-    with open(fpath, 'rb') as f:
-        raw = f.read(4)
-        if len(raw) < 4:
-            return {}
-        (num_elements,) = struct.unpack('<I', raw)
-        for _ in range(num_elements):
-            raw = f.read(4)
-            if len(raw) < 4:
-                break
-            (size,) = struct.unpack('<I', raw)
-            total_positions += size
-            if size > max_positions:
-                max_positions = size
-            f.seek(size * 8, 1)  # skip seq_pos[size]: each is 2 x uint32_t
-    return {
+    pos = {
         'num_elements':    num_elements,
-        'total_positions': total_positions,
+        'total_positions': num_positions,
         'max_positions':   max_positions,
+        'bytes':           tries_off - positions_off,
+        'bytes_fixed':     num_positions * 8,
     }
+    return kmer, pos
 
 
 def _read_idx_stats_yaml(yaml_file: Path) -> dict:
@@ -1580,7 +1568,7 @@ def _collect_ref_index_stats(idx_dir: Path, ref_path: str) -> dict:
 
     Preference order:
       1. *.idx_stats.yaml written by sortmerna at build time (fast, no binary parsing)
-      2. Binary *.stats + *.kmer_0.dat + *.pos_0.dat parsed directly (fallback)
+      2. Binary *.stats + *.idx_0.dat parsed directly (fallback)
     '''
     ST = '[_collect_ref_index_stats]'
     ref_resolved = str(Path(ref_path).resolve())
@@ -1619,20 +1607,18 @@ def _collect_ref_index_stats(idx_dir: Path, ref_path: str) -> dict:
 
     files_stats = {'stats': sf.stat().st_size}
     for part_idx in range(matched_stats['part_num']):
-        for pfx in ('bursttrie', 'pos', 'kmer'):
-            fname = f'{pfx}_{part_idx}.dat'
-            fp = Path(f'{matched_prefix}.{fname}')
-            if fp.exists():
-                files_stats[fname] = fp.stat().st_size
+        fname = f'idx_{part_idx}.dat'
+        fp = Path(f'{matched_prefix}.{fname}')
+        if fp.exists():
+            files_stats[fname] = fp.stat().st_size
     result['files'] = files_stats
 
-    kmer_file = Path(f'{matched_prefix}.kmer_0.dat')
-    if kmer_file.exists():
-        result['kmer'] = _parse_kmer_binary(kmer_file)
-
-    pos_file = Path(f'{matched_prefix}.pos_0.dat')
-    if pos_file.exists():
-        result['pos'] = _parse_pos_binary(pos_file)
+    idx_file = Path(f'{matched_prefix}.idx_0.dat')
+    if idx_file.exists():
+        kmer, pos = _parse_idx_binary(idx_file)
+        if kmer:
+            result['kmer'] = kmer
+            result['pos'] = pos
 
     return result
 
@@ -45,6 +45,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include "refstats.hpp"
 #include "references.hpp"
 #include "readstats.hpp"
+#include "workspace.hpp"
 
 #define ASCENDING <
 #define DESCENDING >
@@ -55,40 +56,16 @@ uint32_t inline findMinIndex(std::vector<s_align2>& alignv);
 uint32_t inline findMaxIndex(std::vector<s_align2>& alignv);
 std::pair<bool,bool> is_id_cov_pass(std::string& read_iseq, s_align2& alignment, References& refs, Runopts& opts);
 
-/* Build a parasail scoring matrix for the ACGTN alphabet with SortMeRNA's scoring scheme.
-   score_N is applied to all pairs involving N (index 4), which may differ from mismatch. */
-static parasail_matrix_t* smr_create_matrix(int match, int mismatch, int score_N)
+void find_lis( const pair<uint32_t, uint32_t>* a, std::size_t n, vector<uint32_t>& b, vector<uint32_t>& p )
 {
-    parasail_matrix_t* mat = parasail_matrix_create("ACGTN", match, mismatch);
-    for (int j = 0; j < 5; ++j)
-        parasail_matrix_set_value(mat, 4, j, score_N); // N row
-    for (int i = 0; i < 4; ++i)
-        parasail_matrix_set_value(mat, i, 4, score_N); // N column
-    return mat;
-}
-
-/* Decode an integer-encoded (0-4 = A,C,G,T,N) sequence slice to character form for parasail. */
-static std::string smr_decode_seq(const char* src, int len)
-{
-    static const char nt_decode[5] = {'A', 'C', 'G', 'T', 'N'};
-    std::string s(len, 'N');
-    for (int i = 0; i < len; ++i) {
-        const auto b = static_cast<uint8_t>(src[i]);
-        s[i] = nt_decode[b < 5u ? b : 4u];
-    }
-    return s;
-}
-
-void find_lis( deque<pair<uint32_t, uint32_t>>& a, vector<uint32_t>& b )
-{
-	vector<uint32_t> p(a.size());
 	std::size_t u, v;
 
-	if (a.empty()) return;
+	if (n == 0) return;
 
+	p.assign(n, 0);
 	b.push_back(0);
 
-	for (std::size_t i = 1; i < a.size(); i++)
+	for (std::size_t i = 1; i < n; i++)
 	{
 		// If next element a[i] is greater than last element of current longest subsequence a[b.back()], just push it at back of "b" and continue
 		if (a[b.back()].second < a[i].second)
@@ -121,50 +98,558 @@ void find_lis( deque<pair<uint32_t, uint32_t>>& a, vector<uint32_t>& b )
 		b[u] = static_cast<uint32_t>(v);
 } // ~find_lis
 
+/* the reference window and the read slice of an SW alignment */
+struct SwWindow
+{
+	std::size_t head = 0; // number of nucleotides added to the reference window before the read start
+	std::size_t tail = 0; // number of nucleotides added to the reference window after the read end
+	std::size_t align_ref_start = 0;
+	std::size_t align_que_start = 0;
+	std::size_t align_length = 0;
+};
+
+/*
+ * the reference window and the read slice to align given the LIS start on the reference and on the read.
+ * The window covers the read plus up to 'edges' nucleotides on each side
+ */
+static SwWindow sw_window(uint32_t lcs_ref_start, uint32_t lcs_que_start, std::size_t reflen, std::size_t readlen, Runopts& opts)
+{
+	SwWindow win;
+	uint32_t edges = 0;
+	if (opts.is_as_percent)
+		edges = static_cast<decltype(edges)>((opts.edges / 100.0) * readlen);
+	else
+		edges = static_cast<decltype(edges)>(opts.edges);
+	// part of the read hangs off (or matches exactly) the beginning of the reference seq
+	//            ref |-----------------------------------|
+	// que |-------------------|
+	//             LIS |-----|
+	//
+	if (lcs_ref_start < lcs_que_start)
+	{
+		win.align_ref_start = 0;
+		win.align_que_start = lcs_que_start - lcs_ref_start;
+		win.head = 0;
+		// the read is longer than the reference sequence
+		//            ref |----------------|
+		// que |---------------------...|
+		//                LIS |-----|
+		//
+		if (reflen < readlen)
+		{
+			win.tail = 0;
+			// beginning from align_ref_start = 0 and align_que_start = X, the read finishes
+			// before the end of the reference
+			//            ref |----------------|
+			// que |------------------------|
+			//                  LIS |-----|
+			//                ^
+			//                align_que_start
+			if (win.align_que_start >(readlen - reflen))
+			{
+				win.align_length = reflen - (win.align_que_start - (readlen - reflen));
+			}
+			// beginning from align_ref_start = 0 and align_que_start = X, the read finishes
+			// after the end of the reference
+			//            ref |----------------|
+			// que |------------------------------|
+			//                  LIS |-----|
+			//                ^
+			//                align_que_start
+			else
+			{
+				win.align_length = reflen;
+			}
+		}
+		else
+		{
+			win.tail = reflen - win.align_ref_start - readlen;
+			win.tail > (edges - 1) ? win.tail = edges : win.tail;
+			win.align_length = readlen + win.head + win.tail - win.align_que_start;
+		}
+	}
+	else
+	{
+		win.align_ref_start = lcs_ref_start - lcs_que_start;
+		win.align_que_start = 0;
+		win.align_ref_start > (edges - 1) ? win.head = edges : win.head;
+		// part of the read hangs off the end of the reference seq
+		// ref |-----------------------------------|
+		//                          que |-------------------|
+		//                            LIS |-----|
+		//
+		if (win.align_ref_start + readlen > reflen) // readlen
+		{
+			win.tail = 0;
+			win.align_length = reflen - win.align_ref_start - win.head;
+		}
+		// the reference seq fully covers the read
+		// ref |-----------------------------------|
+		//    que |-------------------|
+		//          LIS |-----|
+		//
+		else
+		{
+			win.tail = reflen - win.align_ref_start - readlen;
+			win.tail > (edges - 1) ? win.tail = edges : win.tail;
+			win.align_length = readlen + win.head + win.tail;
+		}
+	}
+	return win;
+} // ~sw_window
+
+/*
+ * SW alignment of the query (read slice) against the reference window using parasail
+ *
+ * @param que_offset, ref_offset  positions of the query and the reference window on the read and on the reference
+ * @param alignment  OUT  CIGAR and the alignment coordinates on the read and the reference. Only set if score > min_score
+ * @return the alignment score or -1 if parasail failed
+ */
+static int align_full( Workspace& ws, const char* qseq, int qlen, const char* rseq, int rlen,
+					   int32_t que_offset, int32_t ref_offset, int min_score, Runopts& opts, s_align2& alignment )
+{
+	parasail_profile_t* pprofile = ws.query_profile(qseq, qlen); // per thread, reused while the query is the same
+
+	parasail_result_t* presult = parasail_sw_trace_striped_profile_sat(
+		pprofile, rseq, rlen, opts.gap_open, opts.gap_extension);
+	if (presult == nullptr)
+		return -1;
+
+	const int pscore = parasail_result_get_score(presult);
+	if (pscore > min_score)
+	{
+		parasail_cigar_t* pcigar = parasail_result_get_cigar(
+			presult, qseq, qlen, rseq, rlen, ws.matrix);
+		if (pcigar) {
+			// Normalise parasail CIGAR to BAM encoding expected by callers:
+			// parasail uses '='(op=7) for exact match and 'X'(op=8) for mismatch;
+			// all callers expect combined M(op=0). Merge adjacent runs.
+			// I(op=1) and D(op=2) are already in standard orientation.
+			for (int ci = 0; ci < pcigar->len; ++ci) {
+				uint32_t op  = pcigar->seq[ci] & 0xfu;
+				uint32_t len = pcigar->seq[ci] >> 4u;
+				if (op == 7 || op == 8) op = 0; // '='/'X' -> M
+				// merge consecutive M blocks from adjacent '='+'X' runs
+				if (op == 0 && !alignment.cigar.empty()
+						&& (alignment.cigar.back() & 0xfu) == 0)
+					alignment.cigar.back() += (len << 4u);
+				else
+					alignment.cigar.push_back((len << 4u) | op);
+			}
+			alignment.ref_begin1  = pcigar->beg_ref + ref_offset;
+			alignment.read_begin1 = pcigar->beg_query + que_offset;
+			parasail_cigar_free(pcigar);
+			// Parasail adds leading D ops when traceback exits through the query
+			// boundary (i<0): remaining reference-window positions are dumped as D.
+			// SW local alignment never genuinely starts with a deletion (negative
+			// score). Strip them and advance ref_begin1 past the head-extension bases.
+			while (!alignment.cigar.empty() && (alignment.cigar[0] & 0xfu) == 2) {
+				alignment.ref_begin1 += alignment.cigar[0] >> 4u;
+				alignment.cigar.erase(alignment.cigar.begin());
+			}
+		}
+		alignment.ref_end1  = parasail_result_get_end_ref(presult)   + ref_offset;
+		alignment.read_end1 = parasail_result_get_end_query(presult) + que_offset;
+	}
+
+	parasail_result_free(presult);
+	return pscore;
+} // ~align_full
+
+/*
+ * score only SW (no traceback) of the query against the reference window, same scoring as 'align_full'.
+ * The CIGAR of the alignments that are kept is produced later by 'align_full' on the same window.
+ *
+ * @param alignment  OUT  end positions on the read and the reference. Only set if score > min_score
+ * @return the alignment score or -1 if parasail failed
+ */
+static int score_full( Workspace& ws, const char* qseq, int qlen, const char* rseq, int rlen,
+					   int32_t que_offset, int32_t ref_offset, int min_score, Runopts& opts, s_align2& alignment )
+{
+	parasail_profile_t* pprofile = ws.query_profile(qseq, qlen);
+
+	parasail_result_t* presult = parasail_sw_striped_profile_sat(
+		pprofile, rseq, rlen, opts.gap_open, opts.gap_extension);
+	if (presult == nullptr)
+		return -1;
+
+	const int pscore = parasail_result_get_score(presult);
+	if (pscore > min_score)
+	{
+		alignment.ref_end1  = parasail_result_get_end_ref(presult)   + ref_offset;
+		alignment.read_end1 = parasail_result_get_end_query(presult) + que_offset;
+	}
+
+	parasail_result_free(presult);
+	return pscore;
+} // ~score_full
+
+/*
+ * lossy heuristic (OPT_XDROP_LOSSY): ungapped X-drop extension of the LIS seeds along their diagonals. Each extension
+ * runs left and right from the seed cell until the running score drops 'opts.xdrop_lossy' below the best one.
+ * The seeds inside an already extended segment of their diagonal are skipped.
+ * The sum is not a bound of the SW score: a gap next to a seed ends its extension, while the SW crosses it.
+ *
+ * @param matches, lis_arr  the LIS seeds [pos on ref, pos on read]
+ * @return true if the sum of the best segment scores over the seeds is not above the 'min_score' i.e. the SW
+ *         of the window is skipped. Counted in 'ws.num_xdrop' and 'ws.num_xdrop_skipped'
+ */
+static bool xdrop_skip( Workspace& ws, const char* qseq, int qlen, const char* rseq, int rlen, const uint32pair* matches,
+						const std::vector<uint32_t>& lis_arr, int32_t que_offset, int32_t ref_offset, int min_score, Runopts& opts )
+{
+	auto sub = [&opts](int a, int b) { return (a == 4 || b == 4) ? opts.score_N : (a == b ? opts.match : opts.mismatch); };
+	int total = 0;
+	int32_t last_diag = INT32_MIN;
+	int32_t last_end = -1; // query end of the last segment on 'last_diag'
+	for (auto lis_i : lis_arr)
+	{
+		const int32_t qi = static_cast<int32_t>(matches[lis_i].second) - que_offset;
+		const int32_t rj = static_cast<int32_t>(matches[lis_i].first) - ref_offset;
+		if (qi < 0 || qi >= qlen || rj < 0 || rj >= rlen)
+			continue;
+		const int32_t diag = rj - qi;
+		if (diag == last_diag && qi <= last_end)
+			continue; // inside the last segment
+
+		// right, from the seed cell
+		int score = 0;
+		int best_right = 0;
+		int32_t end = qi;
+		for (int32_t i = qi, j = rj; i < qlen && j < rlen; ++i, ++j)
+		{
+			score += sub(static_cast<uint8_t>(qseq[i]), static_cast<uint8_t>(rseq[j]));
+			if (score > best_right) { best_right = score; end = i; }
+			else if (score < best_right - opts.xdrop_lossy) break;
+		}
+		// left, from the cell before the seed
+		score = 0;
+		int best_left = 0;
+		for (int32_t i = qi - 1, j = rj - 1; i >= 0 && j >= 0; --i, --j)
+		{
+			score += sub(static_cast<uint8_t>(qseq[i]), static_cast<uint8_t>(rseq[j]));
+			if (score > best_left) best_left = score;
+			else if (score < best_left - opts.xdrop_lossy) break;
+		}
+		total += best_right + best_left;
+		last_diag = diag;
+		last_end = end;
+	}
+
+	++ws.num_xdrop;
+	if (total > min_score)
+		return false;
+	++ws.num_xdrop_skipped;
+	return true;
+} // ~xdrop_skip
+
+/*
+ * register the alignment just stored at 'alignv[idx]'. An alignment without the CIGAR yet is queued for the traceback,
+ * an alignment it replaced is dropped from the queue.
+ */
+static void keep_trace(std::vector<SwTrace>& traces, uint32_t idx, bool is_deferred, const SwTrace& trace)
+{
+	traces.erase(std::remove_if(traces.begin(), traces.end(), [idx](const SwTrace& tr) { return tr.idx == idx; }), traces.end());
+	if (is_deferred) {
+		traces.push_back(trace);
+		traces.back().idx = idx;
+	}
+}
+
+/*
+ * Banded SW alignment (affine gaps, same scoring as 'align_full') of the query against the reference window.
+ * Only the cells (i, j) with band_lo <= j - i <= band_hi are computed i.e. qlen * (band_hi - band_lo + 1) cells
+ * instead of qlen * rlen.
+ *
+ * @param band_lo, band_hi  the band diagonals (reference pos - query pos) in the window coordinates
+ * @return the best score within the band. 'alignment' is only set if score > min_score
+ */
+static int align_banded( Workspace& ws, const char* qseq, int qlen, const char* rseq, int rlen, int32_t band_lo, int32_t band_hi,
+						 int32_t que_offset, int32_t ref_offset, int min_score, Runopts& opts, s_align2& alignment )
+{
+	// trace bits of a cell: H source (0 - start, 1 - diagonal, 2 - F, 3 - E), E opened, F opened
+	enum : uint8_t { TB_DIAG = 1, TB_F = 2, TB_E = 3, TB_H_MASK = 3, TB_E_OPEN = 4, TB_F_OPEN = 8 };
+	const int NEG = INT32_MIN / 2;
+	const int gap_open = static_cast<int>(opts.gap_open);
+	const int gap_ext = static_cast<int>(opts.gap_extension);
+	band_lo = std::max(band_lo, -qlen);
+	band_hi = std::min(band_hi, rlen);
+	if (band_lo > band_hi) return 0;
+	const int width = band_hi - band_lo + 1;
+
+	// row i - 1 and row i of H and F, indexed by the band column k = j - i - band_lo. One extra column on each side
+	ws.band_h.assign(2 * (width + 2), 0);
+	ws.band_f.assign(2 * (width + 2), NEG);
+	ws.band_trace.resize(static_cast<std::size_t>(qlen) * width);
+	int* h_prev = &ws.band_h[1];
+	int* h_cur = &ws.band_h[width + 3];
+	int* f_prev = &ws.band_f[1];
+	int* f_cur = &ws.band_f[width + 3];
+
+	int best = 0;
+	int best_i = 0;
+	int best_j = 0;
+	for (int i = 1; i <= qlen; ++i)
+	{
+		const int a = static_cast<uint8_t>(qseq[i - 1]);
+		uint8_t* trace = &ws.band_trace[static_cast<std::size_t>(i - 1) * width];
+		int e = NEG;
+		h_cur[-1] = 0;
+		for (int k = 0; k < width; ++k)
+		{
+			const int j = i + band_lo + k;
+			if (j < 1 || j > rlen) {
+				h_cur[k] = 0;
+				f_cur[k] = NEG;
+				e = NEG;
+				trace[k] = 0;
+				continue;
+			}
+			const int b = static_cast<uint8_t>(rseq[j - 1]);
+			// E: gap in the query (reference consumed) from the left (i, j-1) i.e. column k-1 of this row
+			const int eo = h_cur[k - 1] - gap_open;
+			const int ee = e - gap_ext;
+			e = std::max(eo, ee);
+			// F: gap in the reference (query consumed) from above (i-1, j) i.e. column k+1 of the previous row
+			const int fo = h_prev[k + 1] - gap_open;
+			const int fe = f_prev[k + 1] - gap_ext;
+			const int f = std::max(fo, fe);
+			// diagonal (i-1, j-1) is column k of the previous row
+			const int sub = (a == 4 || b == 4) ? opts.score_N : (a == b ? opts.match : opts.mismatch);
+			const int d = h_prev[k] + sub;
+			const int h = std::max(std::max(0, d), std::max(e, f));
+			h_cur[k] = h;
+			f_cur[k] = f;
+			uint8_t tb = h == 0 ? 0 : (h == d ? TB_DIAG : (h == e ? TB_E : TB_F));
+			if (eo >= ee) tb |= TB_E_OPEN;
+			if (fo >= fe) tb |= TB_F_OPEN;
+			trace[k] = tb;
+			if (h > best) { best = h; best_i = i; best_j = j; }
+		}
+		h_cur[width] = 0;
+		f_cur[width] = NEG;
+		std::swap(h_prev, h_cur);
+		std::swap(f_prev, f_cur);
+	}
+
+	if (best <= min_score)
+		return best;
+
+	// trace back from the best cell
+	auto push = [&alignment](uint32_t op) {
+		if (!alignment.cigar.empty() && (alignment.cigar.back() & 0xfu) == op)
+			alignment.cigar.back() += 1u << 4u;
+		else
+			alignment.cigar.push_back((1u << 4u) | op);
+	};
+	alignment.cigar.clear();
+	int i = best_i;
+	int j = best_j;
+	int state = 0; // 0 - H, 1 - E, 2 - F
+	while (i > 0 && j > 0 && j - i >= band_lo && j - i <= band_hi)
+	{
+		const uint8_t tb = ws.band_trace[static_cast<std::size_t>(i - 1) * width + (j - i - band_lo)];
+		if (state == 0) {
+			const uint8_t h_src = tb & TB_H_MASK;
+			if (h_src == 0) break;
+			if (h_src == TB_DIAG) { push(0); --i; --j; }
+			else state = h_src == TB_E ? 1 : 2;
+		}
+		else if (state == 1) { push(2); state = (tb & TB_E_OPEN) ? 0 : 1; --j; }
+		else { push(1); state = (tb & TB_F_OPEN) ? 0 : 2; --i; }
+	}
+	std::reverse(alignment.cigar.begin(), alignment.cigar.end());
+	alignment.ref_begin1 = j + ref_offset;
+	alignment.read_begin1 = i + que_offset;
+	alignment.ref_end1 = best_j - 1 + ref_offset;
+	alignment.read_end1 = best_i - 1 + que_offset;
+	return best;
+} // ~align_banded
+
+/*
+ * score all the set 'ws.sw_jobs' together, one job per lane. Score only (no traceback), same scoring as 'align_full'.
+ * The lanes are independent and the inner loops run over the lanes, which the compiler vectorizes.
+ * Shorter queries and references are padded with a code (5) scoring PAD, so that the padded cells
+ * can only be reached through gaps or the PAD, and never score higher than the real cells.
+ */
+static void sw_score_batch(References& refs, Runopts& opts, Workspace& ws)
+{
+	const int16_t PAD = -1000;
+	const int16_t NEG = INT16_MIN / 2;
+	const int16_t match = static_cast<int16_t>(opts.match);
+	const int16_t mismatch = static_cast<int16_t>(opts.mismatch);
+	const int16_t score_N = static_cast<int16_t>(opts.score_N);
+	const int16_t gap_open = static_cast<int16_t>(opts.gap_open);
+	const int16_t gap_ext = static_cast<int16_t>(opts.gap_extension);
+
+	std::size_t max_q = 0;
+	std::size_t max_r = 0;
+	for (auto const& job : ws.sw_jobs) {
+		if (!job.is_set) continue;
+		max_q = std::max<std::size_t>(max_q, job.qlen);
+		max_r = std::max<std::size_t>(max_r, job.rlen);
+	}
+	if (max_q == 0) return;
+
+	// [pos][lane] layout
+	ws.batch_q.assign(max_q * SW_BATCH, 5);
+	ws.batch_r.assign(max_r * SW_BATCH, 5);
+	for (std::size_t l = 0; l < ws.sw_jobs.size(); ++l) {
+		auto const& job = ws.sw_jobs[l];
+		if (!job.is_set) continue;
+		const char* rseq = refs.buffer[ws.refs_kmer_count[ws.batch_first + l].first].sequence.data() + job.ref_start;
+		for (uint32_t i = 0; i < job.qlen; ++i)
+			ws.batch_q[i * SW_BATCH + l] = ws.query04[job.que_start + i];
+		for (uint32_t j = 0; j < job.rlen; ++j)
+			ws.batch_r[j * SW_BATCH + l] = rseq[j];
+	}
+
+	ws.batch_h.assign((max_r + 1) * SW_BATCH, 0); // H(0, j) = 0
+	ws.batch_f.assign((max_r + 1) * SW_BATCH, NEG);
+	int16_t best[SW_BATCH] = {};
+	int16_t e[SW_BATCH];
+	int16_t h_left[SW_BATCH];
+	int16_t h_diag[SW_BATCH];
+	for (std::size_t i = 0; i < max_q; ++i)
+	{
+		const int16_t* __restrict q = &ws.batch_q[i * SW_BATCH];
+		for (int l = 0; l < SW_BATCH; ++l) { e[l] = NEG; h_left[l] = 0; h_diag[l] = 0; } // H(i, 0) = 0
+		for (std::size_t j = 1; j <= max_r; ++j)
+		{
+			const int16_t* __restrict rr = &ws.batch_r[(j - 1) * SW_BATCH];
+			int16_t* __restrict h_up = &ws.batch_h[j * SW_BATCH]; // H(i-1, j) on entry, H(i, j) on exit
+			int16_t* __restrict f = &ws.batch_f[j * SW_BATCH];
+			for (int l = 0; l < SW_BATCH; ++l)
+			{
+				// selects without short-circuit operators i.e. no branches in the lane loop
+				const int16_t ql = q[l];
+				const int16_t rl = rr[l];
+				int16_t sub = ql == rl ? match : mismatch;
+				sub = ((ql == 4) | (rl == 4)) ? score_N : sub;
+				sub = ((ql > 4) | (rl > 4)) ? PAD : sub;
+				const int16_t el = std::max<int16_t>(h_left[l] - gap_open, e[l] - gap_ext);
+				const int16_t fl = std::max<int16_t>(h_up[l] - gap_open, f[l] - gap_ext);
+				const int16_t h = std::max<int16_t>(std::max<int16_t>(0, h_diag[l] + sub), std::max(el, fl));
+				e[l] = el;
+				f[l] = fl;
+				h_diag[l] = h_up[l];
+				h_up[l] = h;
+				h_left[l] = h;
+				best[l] = std::max(best[l], h);
+			}
+		}
+	}
+
+	for (std::size_t l = 0; l < ws.sw_jobs.size(); ++l) {
+		if (ws.sw_jobs[l].is_set)
+			ws.sw_jobs[l].score = best[l];
+	}
+} // ~sw_score_batch
+
+/*
+ * sort the k-mer hits (hits_on_ref) of the next SW_BATCH candidate references starting at 'k_first',
+ * find the first SW window of each candidate the same way 'compute_lis_alignment' does it i.e. the LIS of the
+ * hits fitting the read length from the first hit, and score these windows together in 'sw_score_batch'
+ */
+static void prepare_sw_batch(std::size_t k_first, Read& read, Runopts& opts, Index& index, References& refs, Refstats& refstats, Workspace& ws)
+{
+	auto const& candidates = ws.refs_kmer_count;
+	const std::size_t n = std::min<std::size_t>(SW_BATCH, candidates.size() - k_first);
+	ws.batch_first = k_first;
+	ws.sw_jobs.assign(n, SwJob());
+
+	for (std::size_t c = 0; c < n; ++c)
+	{
+		// sort the positions in ascending order
+		std::sort(ws.cand_hits.begin() + ws.cand_hits_pos[k_first + c], ws.cand_hits.begin() + ws.cand_hits_pos[k_first + c + 1],
+			[](uint32pair e1, uint32pair e2) {
+			if (e1.first == e2.first) 
+				return (e1.second ASCENDING e2.second); // order references ascending for equal reference positions
+			return (e1.first ASCENDING e2.first);
+		}); // smallest
+	}
+
+	// the scores have to fit int16 lanes
+	const int max_sub = std::max(opts.match, opts.score_N);
+	if (n < 2 || max_sub * static_cast<int64_t>(read.sequence.size()) > 30000 || opts.mismatch < -10000 || opts.score_N < -10000
+		|| opts.gap_open + opts.gap_extension > 10000)
+		return;
+
+	// the read in 04 encoding, see 'Read::flip34'. The read itself is only flipped if it is aligned
+	if (ws.query04.empty())
+		ws.query04 = read.get04Seq();
+
+	for (std::size_t c = 0; c < n; ++c)
+	{
+		const uint32pair* hits = ws.cand_hits.data() + ws.cand_hits_pos[k_first + c];
+		const std::size_t num_hits = ws.cand_hits_pos[k_first + c + 1] - ws.cand_hits_pos[k_first + c];
+		if (num_hits == 0) continue;
+		// the first window i.e. the hits from the first one fitting the read length
+		auto end_ref_max = hits[0].first + read.sequence.length() - hits[0].second - refstats.lnwin[index.index_num] + 1;
+		std::size_t num_matches = 0;
+		while (num_matches < num_hits && hits[num_matches].first <= end_ref_max)
+			++num_matches;
+		if (num_matches < (uint32_t)opts.num_seeds) continue;
+
+		ws.lis_arr.clear();
+		find_lis(hits, num_matches, ws.lis_arr, ws.lis_prev);
+		if (ws.lis_arr.size() < (size_t)opts.min_lis) continue;
+
+		const uint32_t ref = candidates[k_first + c].first;
+		const SwWindow win = sw_window(hits[ws.lis_arr[0]].first, hits[ws.lis_arr[0]].second,
+			refs.buffer[ref].sequence.length(), read.sequence.length(), opts);
+		auto& job = ws.sw_jobs[c];
+		job.is_set = true;
+		job.que_start = static_cast<uint32_t>(win.align_que_start);
+		job.qlen = static_cast<uint32_t>(win.align_length - win.head - win.tail);
+		job.ref_start = static_cast<uint32_t>(win.align_ref_start - win.head);
+		job.rlen = static_cast<uint32_t>(win.align_length);
+	}
+
+	sw_score_batch(refs, opts, ws);
+} // ~prepare_sw_batch
+
 void compute_lis_alignment( Read& read, Runopts& opts,
 							Index& index, References& refs,
 							Readstats& readstats, Refstats& refstats,
-							bool& search, uint32_t max_SW_score	)
+							bool& search, uint32_t max_SW_score, Workspace& ws )
 {
 	// true if SW alignment between the read and a candidate reference meets the threshold
 	bool is_aligned = false;
 
-	parasail_matrix_t* matrix = smr_create_matrix(opts.match, opts.mismatch, opts.score_N);
+	auto& ref_hits = ws.ref_hits; // kmer hits on candidate references
+	//    [pair<1st:reference number/position in the ref file, 2nd:number of k-mer hits on the reference>]
 
-	map<uint32_t, uint32_t> refs_kmer_count_map; // map of kmer hits on candidate references
-	//    |         |_number of k-mer hits on the reference
-	//    |_reference number/position in the ref file
-
-	vector<uint32pair> refs_kmer_count_vec; // use to sort the 'refs_kmer_count_map' (map cannot be sorted)
-	map<uint32_t, uint32_t>::iterator map_it;
+	auto& refs_kmer_count_vec = ws.refs_kmer_count; // 'ref_hits' of the references with enough hits
 	uint32_t max_ref = 0; // reference with max kmer occurrences
 	uint32_t max_occur = 0; // number of kmer occurrences on the 'max_ref'
 
-	// 1. For each candidate reference compute the number of kmer hits belonging to it
+	// 1. For each candidate reference compute the number of kmer hits belonging to it.
+	//    'ws.ref_slot' maps a reference to its entry in 'ref_hits' i.e. no sort and no map
+	auto& ref_slot = ws.ref_slot;
+	if (ref_slot.size() < refs.buffer.size())
+		ref_slot.resize(refs.buffer.size(), UINT32_MAX);
+	ref_hits.clear();
 	for (auto const& hit: read.id_win_hits)
 	{
-		seq_pos* positions_tbl_ptr = index.positions_tbl[hit.id].arr;
-		// loop all positions of id
-		for (uint32_t j = 0; j < index.positions_tbl[hit.id].size; j++)
+		// loop all references of id. The positions are grouped by reference
+		for (auto cur = index.positions(hit.id); cur.next_ref(); )
 		{
-			uint32_t seq = positions_tbl_ptr++->seq;
-			if ((map_it = refs_kmer_count_map.find(seq)) != refs_kmer_count_map.end())
-				map_it->second++; // sequence already in the map, increment its frequency value
-			else
-				refs_kmer_count_map[seq] = 1; // sequence not in the map, add it
+			if (ref_slot[cur.seq] == UINT32_MAX) {
+				ref_slot[cur.seq] = static_cast<uint32_t>(ref_hits.size());
+				ref_hits.emplace_back(cur.seq, 0);
+			}
+			ref_hits[ref_slot[cur.seq]].second += cur.count;
 		}
 	}
 
-	// copy frequency map to vector for sorting
 	// consider only candidate references that have enough seed hits
-	for (auto const& freq_pair: refs_kmer_count_map)
+	refs_kmer_count_vec.clear();
+	for (auto const& freq_pair : ref_hits)
 	{
 		if (freq_pair.second >= (uint32_t)opts.num_seeds)
 			refs_kmer_count_vec.push_back(freq_pair);
 	}
 
-	refs_kmer_count_map.clear();
-
 	// sort sequences by frequency in descending order
 	auto cmp = [](std::pair<uint32_t, uint32_t> e1, std::pair<uint32_t, uint32_t> e2) {
 		if (e1.second == e2.second)
@@ -173,6 +658,42 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 	}; // comparator
 	std::sort(refs_kmer_count_vec.begin(), refs_kmer_count_vec.end(), cmp);
 
+	// 2. bucket the hits [pos on ref, pos on read] by candidate in one pass over the positions.
+	//    The buckets follow the candidates order. A bucket is sorted when its candidate is prepared (see prepare_sw_batch)
+	auto& ref_fill = ws.ref_fill; // per 'ref_hits' entry: next free position in the candidate's bucket
+	ref_fill.assign(ref_hits.size(), UINT32_MAX); // not a candidate
+	ws.cand_hits_pos.clear();
+	std::size_t num_cand_hits = 0;
+	for (auto const& cand : refs_kmer_count_vec)
+	{
+		ref_fill[ref_slot[cand.first]] = static_cast<uint32_t>(num_cand_hits);
+		ws.cand_hits_pos.push_back(num_cand_hits);
+		num_cand_hits += cand.second;
+	}
+	ws.cand_hits_pos.push_back(num_cand_hits);
+	ws.cand_hits.resize(num_cand_hits);
+	if (num_cand_hits > 0)
+	{
+		for (auto const& hit : read.id_win_hits)
+		{
+			for (auto cur = index.positions(hit.id); cur.next_ref(); )
+			{
+				uint32_t& fill = ref_fill[ref_slot[cur.seq]];
+				if (fill == UINT32_MAX) continue; // the positions are skipped by 'next_ref'
+				while (cur.left > 0)
+					ws.cand_hits[fill++] = uint32pair(cur.next_pos(), hit.win);
+			}
+		}
+	}
+	for (auto const& freq_pair : ref_hits)
+		ref_slot[freq_pair.first] = UINT32_MAX;
+
+	// no candidates are prepared yet
+	ws.batch_first = 0;
+	ws.sw_traces.clear();
+	ws.sw_jobs.clear();
+	ws.query04.clear();
+
 	// 2. loop reference candidates, starting from the one with the highest number of kmer hits.
 	auto is_search_candidates = true;
 	for (uint32_t k = 0; k < refs_kmer_count_vec.size() && is_search_candidates; k++)
@@ -194,42 +715,29 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 			if (read.best < 1) break;
 		}
 
+		//
+		// 3. sort 'hits_on_ref' and score the first SW windows for the next batch of candidates
+		//
+		if (k < ws.batch_first || k >= ws.batch_first + ws.sw_jobs.size())
+			prepare_sw_batch(k, read, opts, index, refs, refstats, ws);
+
 		// list of matching kmer pairs on a given reference: 
 		//  [pair<1st:k-mer ref pos, 2nd:k-mer read pos>] e.g.
 		//  [ (493, 0), ..., (674, 18), ... ]
 		//      |   |_k-mer position on the read
 		//      |_k-mer position on the reference
-		vector<uint32pair> hits_on_ref;
-
-		//
-		// 3. populate 'hits_on_ref'
-		//
-		for ( auto const& hit: read.id_win_hits )
-		{
-			uint32_t num_hits = index.positions_tbl[hit.id].size;
-			seq_pos* positions_tbl_ptr = index.positions_tbl[hit.id].arr;
-			// loop through every position of id
-			for (uint32_t j = 0; j < num_hits; j++)
-			{
-				if (positions_tbl_ptr->seq == max_ref)
-				{
-					hits_on_ref.push_back(uint32pair(positions_tbl_ptr->pos, hit.win));
-				}
-				positions_tbl_ptr++;
-			}
-		}
-
-		// sort the positions in ascending order
-		std::sort(hits_on_ref.begin(), hits_on_ref.end(), [](uint32pair e1, uint32pair e2) {
-			if (e1.first == e2.first) 
-				return (e1.second ASCENDING e2.second); // order references ascending for equal reference positions
-			return (e1.first ASCENDING e2.first);
-		}); // smallest
+		const uint32pair* hits_on_ref = ws.cand_hits.data() + ws.cand_hits_pos[k];
+		const uint32pair* hits_on_ref_end = ws.cand_hits.data() + ws.cand_hits_pos[k + 1];
+		const SwJob& sw_job = ws.sw_jobs[k - ws.batch_first];
 
 		// iterate over the set of hits, searching for windows of
 		// win.len == read.len which have at least ratio hits
-		vector<uint32pair>::iterator hits_on_ref_iter = hits_on_ref.begin();
-		deque<uint32pair> match_set; // set of matching k-mers fit within the read length: [pair<1st:on ref pos, 2nd:on read pos>]
+		const uint32pair* hits_on_ref_iter = hits_on_ref;
+		// set of matching k-mers fit within the read length: [pair<1st:on ref pos, 2nd:on read pos>]
+		// used as a queue, the front is at 'ws.match_head'
+		auto& match_set = ws.match_set;
+		match_set.clear();
+		ws.match_head = 0;
 
 		// 4. run a sliding window of read's length along the reference, 
 		//    searching for windows with enough k-mer hits
@@ -240,7 +748,7 @@ void compute_lis_alignment( Read& read, Runopts& opts,
                        
 		// TODO: Always does a single iteration because of the line '++hits_on_ref_iter'. 
 		//       It has 3 'break' instructions though. Convoluted.
-		while (hits_on_ref_iter != hits_on_ref.end() && is_search_candidates)
+		while (hits_on_ref_iter != hits_on_ref_end && is_search_candidates)
 		{
 			// max possible k-mer start position on reference: 
 			//   max start position on the reference of a matching k-mer for 
@@ -256,7 +764,7 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 			//auto end_ref_max = begin_ref + read.sequence.length() - refstats.lnwin[index.index_num] + 1; // TODO: original - remove
 			auto end_ref_max = begin_ref + read.sequence.length() - begin_read - refstats.lnwin[index.index_num] + 1;
 			auto push = false;
-			while ( hits_on_ref_iter != hits_on_ref.end() && hits_on_ref_iter->first <= end_ref_max )
+			while ( hits_on_ref_iter != hits_on_ref_end && hits_on_ref_iter->first <= end_ref_max )
 			{
 				match_set.push_back(*hits_on_ref_iter);
 				push = true;
@@ -274,10 +782,12 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 			aligned = false;
 #endif                              
 			// enough windows at this position on genome to search for LIS
-			if (match_set.size() >= (uint32_t)opts.num_seeds)
+			if (match_set.size() - ws.match_head >= (uint32_t)opts.num_seeds)
 			{
-				vector<uint32_t> lis_arr; // array of Indices of matches from the match_set comprising the LIS
-				find_lis(match_set, lis_arr);
+				const uint32pair* matches = &match_set[ws.match_head];
+				auto& lis_arr = ws.lis_arr; // array of Indices of matches from the match_set comprising the LIS
+				lis_arr.clear();
+				find_lis(matches, match_set.size() - ws.match_head, lis_arr, ws.lis_prev);
 #ifdef HEURISTIC1_OFF
 				uint32_t list_n = 0;
 				do
@@ -287,163 +797,76 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 					if (lis_arr.size() >= (size_t)opts.min_lis)
 					{
 #ifdef HEURISTIC1_OFF
-						lcs_ref_start = match_set[lis_arr[list_n]].first;
-						lcs_que_start = match_set[lis_arr[list_n]].second;
+						lcs_ref_start = matches[lis_arr[list_n]].first;
+						lcs_que_start = matches[lis_arr[list_n]].second;
 #endif
 #ifndef HEURISTIC1_OFF
-						lcs_ref_start = match_set[lis_arr[0]].first;
-						lcs_que_start = match_set[lis_arr[0]].second;
+						lcs_ref_start = matches[lis_arr[0]].first;
+						lcs_que_start = matches[lis_arr[0]].second;
 #endif                                    
-						// reference string
-						std::size_t head = 0;
-						std::size_t tail = 0;
-						std::size_t align_ref_start = 0;
-						std::size_t align_que_start = 0;
-						std::size_t align_length = 0;
-						auto reflen = refs.buffer[max_ref].sequence.length();
-						uint32_t edges = 0;
-						if (opts.is_as_percent)
-							edges = static_cast<decltype(edges)>((opts.edges / 100.0) * read.sequence.length());
-						else
-							edges = static_cast<decltype(edges)>(opts.edges);
-						// part of the read hangs off (or matches exactly) the beginning of the reference seq
-						//            ref |-----------------------------------|
-						// que |-------------------|
-						//             LIS |-----|
-						//
-						if (lcs_ref_start < lcs_que_start)
-						{
-							align_ref_start = 0;
-							align_que_start = lcs_que_start - lcs_ref_start;
-							head = 0;
-							// the read is longer than the reference sequence
-							//            ref |----------------|
-							// que |---------------------...|
-							//                LIS |-----|
-							//
-							if (reflen < read.sequence.length())
-							{
-								tail = 0;
-								// beginning from align_ref_start = 0 and align_que_start = X, the read finishes
-								// before the end of the reference
-								//            ref |----------------|
-								// que |------------------------|
-								//                  LIS |-----|
-								//                ^
-								//                align_que_start
-								if (align_que_start >(read.sequence.length() - reflen))
-								{
-									align_length = reflen - (align_que_start - (read.sequence.length() - reflen));
-								}
-								// beginning from align_ref_start = 0 and align_que_start = X, the read finishes
-								// after the end of the reference
-								//            ref |----------------|
-								// que |------------------------------|
-								//                  LIS |-----|
-								//                ^
-								//                align_que_start
-								else
-								{
-									align_length = reflen;
-								}
-							}
-							else
-							{
-								tail = reflen - align_ref_start - read.sequence.length();
-								tail > (edges - 1) ? tail = edges : tail;
-								align_length = read.sequence.length() + head + tail - align_que_start;
-							}
-						}
-						else
-						{
-							align_ref_start = lcs_ref_start - lcs_que_start;
-							align_que_start = 0;
-							align_ref_start > (edges - 1) ? head = edges : head;
-							// part of the read hangs off the end of the reference seq
-							// ref |-----------------------------------|
-							//                          que |-------------------|
-							//                            LIS |-----|
-							//
-							if (align_ref_start + read.sequence.length() > reflen) // readlen
-							{
-								tail = 0;
-								align_length = reflen - align_ref_start - head;
-							}
-							// the reference seq fully covers the read
-							// ref |-----------------------------------|
-							//    que |-------------------|
-							//          LIS |-----|
-							//
-							else
-							{
-								tail = reflen - align_ref_start - read.sequence.length();
-								tail > (edges - 1) ? tail = edges : tail;
-								align_length = read.sequence.length() + head + tail;
-							}
-						}
+						const SwWindow win = sw_window(lcs_ref_start, lcs_que_start, refs.buffer[max_ref].sequence.length(), read.sequence.length(), opts);
+						const std::size_t head = win.head;
+						const std::size_t tail = win.tail;
+						const std::size_t align_ref_start = win.align_ref_start;
+						const std::size_t align_que_start = win.align_que_start;
+						const std::size_t align_length = win.align_length;
 
 						// put read into 04 encoding before alignment
 						if (read.is03)
 							read.flip34();
 
-						// decode integer-encoded slices to character form for parasail
+						// the integer encoded (0-4) slices are aligned as they are, see smr_create_matrix
 						const int qlen = static_cast<int>(align_length - head - tail);
 						const int rlen = static_cast<int>(align_length);
-						const std::string qchars = smr_decode_seq(&read.isequence[0] + align_que_start, qlen);
-						const std::string rchars = smr_decode_seq(
-							refs.buffer[max_ref].sequence.c_str() + align_ref_start - head, rlen);
-
-						parasail_profile_t* pprofile = parasail_profile_create_sat(
-							qchars.c_str(), qlen, matrix);
-
-						parasail_result_t* presult = parasail_sw_trace_striped_profile_sat(
-							pprofile, rchars.c_str(), rlen, opts.gap_open, opts.gap_extension);
+						const char* qseq = &read.isequence[0] + align_que_start;
+						const char* rseq = refs.buffer[max_ref].sequence.c_str() + align_ref_start - head;
+						const int32_t ref_offset = static_cast<int32_t>(align_ref_start - head);
+						const int32_t que_offset = static_cast<int32_t>(align_que_start);
+						const int min_score = refstats.minimal_score[index.index_num];
 
-						parasail_profile_free(pprofile);
+						s_align2 alignment;
+						int pscore = -1;
+						if (sw_job.is_set && sw_job.score <= min_score
+							&& sw_job.que_start == align_que_start && sw_job.qlen == static_cast<uint32_t>(qlen)
+							&& sw_job.ref_start == static_cast<uint32_t>(ref_offset) && sw_job.rlen == static_cast<uint32_t>(rlen))
+						{
+							pscore = sw_job.score; // already scored in the batch and cannot align
+						}
+						else if (opts.xdrop_lossy > 0 && xdrop_skip(ws, qseq, qlen, rseq, rlen, matches, lis_arr, que_offset, ref_offset, min_score, opts))
+						{
+							pscore = 0; // not scored, the window is skipped on the ungapped seed extensions alone
+						}
+						else if (opts.band > 0)
+						{
+							// band around the diagonals (reference pos - read pos) of the LIS seeds, in the window coordinates
+							int32_t diag_min = INT32_MAX;
+							int32_t diag_max = INT32_MIN;
+							for (auto lis_i : lis_arr)
+							{
+								int32_t diag = (static_cast<int32_t>(matches[lis_i].first) - ref_offset)
+									- (static_cast<int32_t>(matches[lis_i].second) - que_offset);
+								diag_min = std::min(diag_min, diag);
+								diag_max = std::max(diag_max, diag);
+							}
+							pscore = align_banded(ws, qseq, qlen, rseq, rlen, diag_min - opts.band, diag_max + opts.band,
+								que_offset, ref_offset, min_score, opts, alignment);
+							if (pscore <= min_score)
+								pscore = -1; // the best path may leave the band - use the full SW
+						}
+						// score only. The traceback is only done for the alignments kept in 'alignv', see 5.
+						bool is_deferred = false;
+						if (pscore < 0) {
+							pscore = score_full(ws, qseq, qlen, rseq, rlen, que_offset, ref_offset, min_score, opts, alignment);
+							is_deferred = true;
+						}
+						const SwTrace trace{ 0, que_offset, qlen, ref_offset, rlen };
 
-						const int pscore = parasail_result_get_score(presult);
-						is_aligned = (presult != nullptr && pscore > refstats.minimal_score[index.index_num]);
+						is_aligned = pscore > min_score;
 						if (is_aligned)
 						{
 							if (static_cast<uint32_t>(pscore) == max_SW_score)
 								++read.max_SW_count; // a max possible score has been found
 
-							const int32_t ref_offset = static_cast<int32_t>(align_ref_start - head);
-							const int32_t que_offset = static_cast<int32_t>(align_que_start);
-
-							s_align2 alignment;
-							parasail_cigar_t* pcigar = parasail_result_get_cigar(
-								presult, qchars.c_str(), qlen, rchars.c_str(), rlen, matrix);
-							if (pcigar) {
-								// Normalise parasail CIGAR to BAM encoding expected by callers:
-								// parasail uses '='(op=7) for exact match and 'X'(op=8) for mismatch;
-								// all callers expect combined M(op=0). Merge adjacent runs.
-								// I(op=1) and D(op=2) are already in standard orientation.
-								for (int ci = 0; ci < pcigar->len; ++ci) {
-									uint32_t op  = pcigar->seq[ci] & 0xfu;
-									uint32_t len = pcigar->seq[ci] >> 4u;
-									if (op == 7 || op == 8) op = 0; // '='/'X' -> M
-									// merge consecutive M blocks from adjacent '='+'X' runs
-									if (op == 0 && !alignment.cigar.empty()
-											&& (alignment.cigar.back() & 0xfu) == 0)
-										alignment.cigar.back() += (len << 4u);
-									else
-										alignment.cigar.push_back((len << 4u) | op);
-								}
-								alignment.ref_begin1  = pcigar->beg_ref + ref_offset;
-								alignment.read_begin1 = pcigar->beg_query + que_offset;
-								parasail_cigar_free(pcigar);
-								// Parasail adds leading D ops when traceback exits through the query
-								// boundary (i<0): remaining reference-window positions are dumped as D.
-								// SW local alignment never genuinely starts with a deletion (negative
-								// score). Strip them and advance ref_begin1 past the head-extension bases.
-								while (!alignment.cigar.empty() && (alignment.cigar[0] & 0xfu) == 2) {
-									alignment.ref_begin1 += alignment.cigar[0] >> 4u;
-									alignment.cigar.erase(alignment.cigar.begin());
-								}
-							}
-							alignment.ref_end1  = parasail_result_get_end_ref(presult)   + ref_offset;
-							alignment.read_end1 = parasail_result_get_end_query(presult) + que_offset;
 							alignment.score1    = static_cast<uint16_t>(pscore);
 							alignment.readlen   = static_cast<uint32_t>(read.sequence.length());
 							alignment.ref_num   = max_ref;
@@ -465,6 +888,7 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 							if (opts.num_alignments == 0 || !opts.is_best || (opts.is_best && read.alignment.alignv.size() < opts.num_alignments))
 							{
 								read.alignment.alignv.emplace_back(alignment);
+								keep_trace(ws.sw_traces, static_cast<uint32_t>(read.alignment.alignv.size() - 1), is_deferred, trace);
 								read.is_new_hit = true; // flag to store in DB
 							}
 							else if ( opts.is_best
@@ -486,6 +910,7 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 
 									// replace the old smallest scored alignment with the new one
 									read.alignment.alignv[min_score_index] = alignment;
+									keep_trace(ws.sw_traces, min_score_index, is_deferred, trace);
 									read.is_new_hit = true; // flag to store in DB
 
 									// if new_hit > max_hit: the old min_hit_idx becomes the new max_hit_idx
@@ -516,8 +941,6 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 							// continue to next read (no need to collect more seeds using another pass)
 							search = false;
 						}//~if aligned
-
-						parasail_result_free(presult);
 					}//~if LIS long enough                               
 #ifdef HEURISTIC1_OFF
 				} while ((hits_on_ref_iter == hits_per_ref.end()) && (++list_n < lis_arr.size()));
@@ -525,14 +948,16 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 			}//~if enough window hits                                                
 		pop:
 			// get the next candidate reference position 
-			if (!match_set.empty())
+			if (ws.match_head < match_set.size())
 			{
-				match_set.pop_front();
+				++ws.match_head;
 			}
 
-			if (match_set.empty())
+			if (ws.match_head == match_set.size())
 			{
-				if (hits_on_ref_iter != hits_on_ref.end()) // TODO: seems Always false
+				match_set.clear();
+				ws.match_head = 0;
+				if (hits_on_ref_iter != hits_on_ref_end) // TODO: seems Always false
 				{
 					begin_ref = hits_on_ref_iter->first; // TODO: seems never reached
 					begin_read = hits_on_ref_iter->second;
@@ -541,13 +966,22 @@ void compute_lis_alignment( Read& read, Runopts& opts,
 			}
 			else
 			{
-				begin_ref = (match_set.front()).first;
-				begin_read = (match_set.front()).second;
+				begin_ref = match_set[ws.match_head].first;
+				begin_read = match_set[ws.match_head].second;
 			}
 		}//~for all matching k-mers on a reference
 	}//~for all reference candidates
 
-	parasail_matrix_free(matrix);
+	// 5. traceback and CIGAR of the alignments kept in 'alignv' (the read is still in 04 encoding on the same strand)
+	for (auto const& trace : ws.sw_traces)
+	{
+		s_align2& alignment = read.alignment.alignv[trace.idx];
+		const char* qseq = &read.isequence[0] + trace.que_offset;
+		const char* rseq = refs.buffer[alignment.ref_num].sequence.c_str() + trace.ref_offset;
+		align_full(ws, qseq, trace.qlen, rseq, trace.rlen, trace.que_offset, trace.ref_offset,
+			refstats.minimal_score[index.index_num], opts, alignment);
+	}
+	ws.sw_traces.clear();
 } // ~compute_lis_alignment
 
 /* 
@@ -188,9 +188,9 @@ void CmdSession::cmdIndex(Runopts & opts, std::string & cmd)
 	refs.load(std::stoi(idxval), std::stoi(partval), opts, refstats);
 	// find kmer prefix hash
 	uint32_t kmerhash = read.hashKmer(std::stoi(posval), 9);
-	if (kmerhash > index.lookup_tbl.size() - 1)
+	if (kmerhash > index.lookup_tbl_size - 1)
 	{
-		std::cout << "Hash: " << kmerhash << " is larger than Lookup table size: " << index.lookup_tbl.size() << std::endl;
+		std::cout << "Hash: " << kmerhash << " is larger than Lookup table size: " << index.lookup_tbl_size << std::endl;
 		return;
 	}
 	std::cout << "read.id: " << readid << " Kmer position: " << posval << " DB matches: " << index.lookup_tbl[kmerhash].count << std::endl;
@@ -213,7 +213,7 @@ void CmdSession::cmdIndex(Runopts & opts, std::string & cmd)
 
 	// search burst-trie
 	traversetrie_align(
-		index.lookup_tbl[kmerhash].trie_F,
+		index.trie_F(kmerhash),
 		0,
 		0,
 		&bitvec[0],
@@ -234,24 +234,26 @@ void CmdSession::cmdIndex(Runopts & opts, std::string & cmd)
 	for (auto it = id_hits.begin(); it != id_hits.end(); ++it)
 	{
 		// sort matches by Reference ID
-		std::sort(&index.positions_tbl[it->id].arr[0],
-			&index.positions_tbl[it->id].arr[index.positions_tbl[it->id].size - 1],
-			[](seq_pos a, seq_pos b) { return a.seq > b.seq; });
+		std::vector<seq_pos> positions;
+		for (auto cur = index.positions(it->id); cur.next_ref(); )
+			while (cur.left > 0)
+				positions.push_back({ cur.next_pos(), cur.seq });
+		std::sort(positions.begin(), positions.end(), [](seq_pos a, seq_pos b) { return a.seq > b.seq; });
 
-		std::cout << "kmer iD: " << it->id << " Num hits: " << index.positions_tbl[it->id].size << std::endl;
+		std::cout << "kmer iD: " << it->id << " Num hits: " << positions.size() << std::endl;
 
-		for ( uint32_t i = 0; i < index.positions_tbl[it->id].size; ++i)
+		for ( uint32_t i = 0; i < positions.size(); ++i)
 		{
 			// populate frequency map
-			auto map_it = seq_kmer_freq_map.find(index.positions_tbl[it->id].arr[i].seq);
+			auto map_it = seq_kmer_freq_map.find(positions[i].seq);
 			if (map_it != seq_kmer_freq_map.end())
 				map_it->second++; // increment the frequency
 			else
-				seq_kmer_freq_map[index.positions_tbl[it->id].arr[i].seq] = 1; // add seq to map with freq = 1
+				seq_kmer_freq_map[positions[i].seq] = 1; // add seq to map with freq = 1
 
-			if (index.positions_tbl[it->id].arr[i].seq == std::stoi(refid))
+			if (positions[i].seq == std::stoi(refid))
 				std::cout << "Found match in Ref: " << std::stoi(refid) 
-				<< " at Ref pos: " << index.positions_tbl[it->id].arr[i].pos 
+				<< " at Ref pos: " << positions[i].pos 
 				<< " hit number: " << i << std::endl;
 		}
 		//std::cout << "Max Reference number: " << index.positions_tbl[it->id].arr[0].seq << std::endl;
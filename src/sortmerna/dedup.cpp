@@ -0,0 +1,183 @@
+/*
+@copyright 2016-2026 Clarity Genomics BVBA
+@copyright 2012-2016 Bonsai Bioinformatics Research Group
+@copyright 2014-2016 Knight Lab, Department of Pediatrics, UCSD, La Jolla
+
+@parblock
+SortMeRNA - next-generation reads filter for metatranscriptomic or total RNA
+
+This is a free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+SortMeRNA is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
+@endparblock
+
+@contributors Jenya Kopylova   jenya.kopylov@gmail.com
+              Laurent Noé      laurent.noe@lifl.fr
+              Pierre Pericard  pierre.pericard@lifl.fr
+              Daniel McDonald  wasade@gmail.com
+              Mikaël Salson    mikael.salson@lifl.fr
+              Hélène Touzet    helene.touzet@lifl.fr
+              Rob Knight       robknight@ucsd.edu
+              biocodz          biocodz@protonmail.com
+*/
+
+/**
+ * @file dedup.cpp
+ * @brief exact duplicate reads, aligned once per distinct sequence
+ */
+
+#include <chrono>
+#include <thread>
+
+#include "dedup.hpp"
+#include "read.hpp"
+#include "readfeed.hpp"
+#include "kvdb.hpp"
+#include "readstats.hpp"
+#include "options.hpp"
+#include "common.hpp"
+
+#define DEDUP_SHARDS 64 // independently locked parts of the pre-pass table
+
+static std::string read_id(uint64_t uid)
+{
+	return Read::db_key(uid >> 48, uid & ((1ULL << 48) - 1));
+}
+
+Dedup::Dedup(Runopts& opts) : opts(opts), shards(DEDUP_SHARDS), num_reads(0), num_distinct(0), prepass_sec(0) {}
+
+/*
+ * @param is_rc  OUT  the read is the reverse complement of the canonical sequence
+ */
+Dedup::Key Dedup::canonical_key(Read& read, bool& is_rc)
+{
+	std::string fwd = read.get04Seq();
+	std::string rev(fwd.rbegin(), fwd.rend());
+	for (auto& nt : rev)
+		nt = nt < 4 ? 3 - nt : 4;
+	is_rc = rev < fwd;
+
+	auto hash = hash128(is_rc ? rev : fwd);
+	return Key{ hash.first, hash.second };
+} // ~Dedup::canonical_key
+
+void Dedup::run_thread(int id, Readfeed& readfeed)
+{
+	uint64_t num_all = 0;
+	std::string readstr;
+	int idx = id * readfeed.num_sense; // same reads split as in 'align2'
+	for (; readfeed.next(idx, readstr);)
+	{
+		{
+			Read read(readstr);
+			if (!read.isEmpty) {
+				read.init(opts);
+				bool is_rc = false;
+				auto key = canonical_key(read, is_rc);
+				const uint64_t uid = (static_cast<uint64_t>(read.readfile_idx) << 48) | read.read_num;
+				auto& shard = shards[key.h2 % DEDUP_SHARDS];
+				std::lock_guard<std::mutex> lock(shard.lock);
+				auto res = shard.map.emplace(key, Entry{ uid, is_rc, 0 });
+				auto& entry = res.first->second;
+				if (uid < entry.rep) {
+					entry.rep = uid; // the first read in the reads order represents the sequence
+					entry.rep_rc = is_rc;
+				}
+				++entry.count;
+				++num_all;
+			}
+			readstr.resize(0);
+		}
+		if (opts.is_paired) idx ^= 1; // switch FWD-REV
+	}
+
+	std::lock_guard<std::mutex> lock(copies_lock);
+	num_reads += num_all;
+} // ~Dedup::run_thread
+
+void Dedup::run(Readfeed& readfeed)
+{
+	INFO("Searching duplicate reads ...");
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::thread> tpool;
+	tpool.reserve(opts.num_proc_thread);
+	for (unsigned i = 0; i < opts.num_proc_thread; i++)
+		tpool.emplace_back(std::thread(&Dedup::run_thread, this, i, std::ref(readfeed)));
+	for (auto& thr : tpool)
+		thr.join();
+	readfeed.rewind_in();
+	readfeed.init_vzlib_in();
+
+	for (auto const& shard : shards)
+		num_distinct += shard.map.size();
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+	prepass_sec = elapsed.count();
+	INFO_MEM("done in [", prepass_sec, "] sec. Reads: ", num_reads, " distinct sequences: ", num_distinct);
+} // ~Dedup::run
+
+bool Dedup::is_copy(Read& read, bool is_record, uint32_t& num_copies)
+{
+	num_copies = 0;
+	bool is_rc = false;
+	auto key = canonical_key(read, is_rc);
+	const uint64_t uid = (static_cast<uint64_t>(read.readfile_idx) << 48) | read.read_num;
+	auto& shard = shards[key.h2 % DEDUP_SHARDS];
+	auto it = shard.map.find(key); // read only after the pre-pass i.e. no lock
+	if (it == shard.map.end())
+		return false;
+	if (it->second.rep == uid) {
+		num_copies = it->second.count - 1;
+		return false;
+	}
+
+	if (is_record) {
+		std::lock_guard<std::mutex> lock(copies_lock);
+		copies.push_back(Copy{ uid, it->second.rep, is_rc != it->second.rep_rc });
+	}
+	return true;
+} // ~Dedup::is_copy
+
+/*
+ * the results of a copy are the results of its representative. The read positions of an alignment are on the read
+ * as aligned (reverse complemented on the reverse strand), so a reverse complement copy only flips the strands.
+ */
+void Dedup::store_copies(KeyValueDatabase& kvdb, Readstats& readstats, double align_sec)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	uint64_t num_stored = 0;
+	KvdbBatch kvdb_batch(kvdb);
+	for (auto const& copy : copies)
+	{
+		std::string bstr = kvdb.get(read_id(copy.rep));
+		if (bstr.empty())
+			continue; // the representative has no alignments
+		Read read;
+		read.fromBinString(bstr);
+		if (copy.is_rc) {
+			for (auto& align : read.alignment.alignv)
+				align.strand = !align.strand;
+			bstr = read.toBinString();
+		}
+		kvdb_batch.put(read_id(copy.read), bstr);
+		readstats.set_hit(copy.read >> 48, copy.read & ((1ULL << 48) - 1));
+		++num_stored;
+	}
+	kvdb_batch.flush();
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	const uint64_t num_copies = copies.size();
+	const uint64_t num_aligned = num_reads - num_copies; // reads searched
+	INFO("Duplicate reads: ", num_copies, " of ", num_reads, " (", num_reads > 0 ? 100.0 * num_copies / num_reads : 0.0, "%)",
+		" distinct sequences: ", num_distinct, " copies with alignments: ", num_stored);
+	INFO("Duplicates pre-pass: ", prepass_sec, " sec, copies stored in: ", elapsed.count(), " sec,",
+		" estimated alignment time saved: ", num_aligned > 0 ? align_sec * num_copies / num_aligned : 0.0, " sec");
+} // ~Dedup::store_copies
@@ -36,7 +36,6 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
  */
 
 
-#include <deque>
 #include <algorithm>
 #include <locale>
 #include <string>
@@ -48,6 +47,14 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include <array>
 #include <sstream>
 #include <filesystem>
+#include <iterator> // std::istreambuf_iterator
+#include <cstring>
+#include <cstdlib> // std::aligned_alloc
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "index.hpp"
 #include "indexdb.hpp"
@@ -58,12 +65,16 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 // forward
 std::string string_hash(const std::string& val); // util.cpp
 
-Index::Index(Runopts& opts) : index_num(0), part(0), number_elements(0), is_ready(false)
+Index::Index(Runopts& opts) 
+	: index_num(0), part(0), number_elements(0), is_ready(false), 
+	lookup_tbl(nullptr), lookup_tbl_size(0), pos_dir(nullptr), positions_tbl(nullptr), 
+	exact_tbl(nullptr), num_exact(0), map_addr(nullptr), map_size(0), is_mapped(false)
 {
 	std::stringstream ss;
-	std::array<std::string, 4> sfxarr{ {".bursttrie_0.dat", ".pos_0.dat", ".kmer_0.dat", ".stats"} };
+	std::array<std::string, 2> sfxarr{ {".idx_0.dat", ".stats"} };
 
-	std::size_t count_indexed = 0;
+	std::vector<std::size_t> idx_to_build; // indices into 'opts.indexfiles' that need (re-)building
+	std::size_t count_missing = 0; // references with no index files at all
 
 	// check the index is ready
 	if (!is_ready) {
@@ -78,6 +89,7 @@ Index::Index(Runopts& opts) : index_num(0), part(0), number_elements(0), is_read
 			}
 
 			// test index files
+			std::size_t count_indexed = 0;
 			for (auto const& sfx : sfxarr)
 			{
 				auto idxfile = opts.indexfiles[idx].second + sfx;
@@ -96,28 +108,45 @@ Index::Index(Runopts& opts) : index_num(0), part(0), number_elements(0), is_read
 					++count_indexed;
 				}
 			}
+
+			if (count_indexed < sfxarr.size())
+			{
+				++count_missing;
+				idx_to_build.push_back(idx);
+				continue;
+			}
+
+			// the index files are there. Validate them against the descriptor
+			if (!is_index_current(opts.indexfiles[idx].first, opts.indexfiles[idx].second, opts))
+			{
+				INFO("Index of [", opts.indexfiles[idx].first, "] is out of date: the reference file or the indexing parameters changed.");
+				idx_to_build.push_back(idx);
+			}
 		}
 
-		if (count_indexed == opts.indexfiles.size() * sfxarr.size())
+		if (idx_to_build.empty())
 		{
 			is_ready = true;
-			INFO("Found ", count_indexed, " non-empty index files. Skipping indexing.\n");
-			if (opts.dbg_level == 2)
-				INFO("TODO: a better validation using an index descriptor to decide on indexing");
+			INFO("Found valid index for all ", opts.indexfiles.size(), " reference files. Skipping indexing.\n");
 		}
-		else
+		else if (opts.findex == 0 && count_missing == 0)
 		{
-			if (count_indexed > 0) {
-				INFO("Found ", count_indexed, " non-empty index files. Going to re-build. TODO: don't build what's already indexed.");
-				is_ready = false;
-			}
+			// indexing is off and all the files are there - use what exists
+			is_ready = true;
+			WARN(idx_to_build.size(), " index(es) are out of date, but '-", OPT_INDEX, " 0' was specified. Using the existing index.");
+		}
+		else if (idx_to_build.size() < opts.indexfiles.size())
+		{
+			INFO("Reusing the index of ", opts.indexfiles.size() - idx_to_build.size(), " reference files. Going to build ", idx_to_build.size());
 		}
 	}
 
 	if (!is_ready) {
 		if (opts.findex == 1) {
 			// test index files writable
-			for (std::size_t idx = 0; idx < opts.indexfiles.size(); ++idx) {
+			for (auto idx : idx_to_build) {
+				// the index is valid only once the descriptor is written at the end of its build
+				std::filesystem::remove(opts.indexfiles[idx].second + INDEX_DESC_SFX);
 				for (auto const& sfx : sfxarr) {
 					auto idxfile = opts.indexfiles[idx].second + sfx;
 					std::ofstream fstrm(idxfile, std::ios::binary | std::ios::out);
@@ -131,7 +160,7 @@ Index::Index(Runopts& opts) : index_num(0), part(0), number_elements(0), is_read
 				}
 			}
 
-			build_index(opts);
+			build_index(opts, idx_to_build);
 		}
 		else {
 			ERR("index is not ready. It has to be generated using option '", OPT_INDEX, "' prior running alignment");
@@ -140,249 +169,168 @@ Index::Index(Runopts& opts) : index_num(0), part(0), number_elements(0), is_read
 	}
 } // ~Index::Index
 
+Index::Index()
+	: index_num(0), part(0), number_elements(0), is_ready(true),
+	lookup_tbl(nullptr), lookup_tbl_size(0), pos_dir(nullptr), positions_tbl(nullptr),
+	exact_tbl(nullptr), num_exact(0), map_addr(nullptr), map_size(0), is_mapped(false)
+{}
+
+Index::~Index()
+{
+	unload();
+}
+
 void Index::load(uint32_t idx_num, uint32_t idx_part, std::vector<std::pair<std::string, std::string>>& indexfiles, Refstats& refstats)
 {
-	// STEP 1: load the kmer 'count' variables (dbname.kmer.dat)
-	std::string idxfile = indexfiles[idx_num].second + ".kmer_" + std::to_string(idx_part) + ".dat";
-	std::ifstream inkmer(idxfile, std::ios::in | std::ios::binary);
+	std::string idxfile = indexfiles[idx_num].second + ".idx_" + std::to_string(idx_part) + ".dat";
+
+	unload(); // the previous part if any
 
-	if (!inkmer.good())
+	int fd = open(idxfile.data(), O_RDONLY);
+	if (fd == -1)
 	{
-		ERR("The index " , idxfile , " does not exist.");
+		ERR("The index ", idxfile, " does not exist: ", strerror(errno));
 		exit(EXIT_FAILURE);
 	}
 
-	uint32_t limit = 1 << refstats.lnwin[idx_num];
-
-	for (uint32_t i = 0; i < limit && !inkmer.eof(); i++)
+	struct stat st;
+	if (fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < sizeof(IndexHeader))
 	{
-		lookup_tbl.push_back(kmer());
-		inkmer.read(reinterpret_cast<char*>(&(lookup_tbl[i].count)), sizeof(uint32_t));
+		close(fd);
+		ERR("The index ", idxfile, " is empty or cannot be read. Please re-build the index.");
+		exit(EXIT_FAILURE);
 	}
-	inkmer.close();
 
-	// STEP 2: load the burst tries ( bursttrief.dat, bursttrier.dat )
-	std::string btriefile = indexfiles[idx_num].second + ".bursttrie_" + std::to_string(idx_part) + ".dat";
-	std::ifstream btrie(btriefile, std::ios::in | std::ios::binary);
-	if (!btrie.good())
+	// map the whole file. The pages are shared through the OS page cache
+	// by all the processes using the same index
+	map_size = st.st_size;
+	void* addr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (addr != MAP_FAILED)
 	{
-		std::stringstream ss;
-		ss << STAMP << "The index " << btriefile << " does not exist.";
-		ERR(ss.str())
-		exit(EXIT_FAILURE);
+		is_mapped = true;
+		madvise(addr, map_size, MADV_WILLNEED); // start reading the file in ahead of the search
 	}
-
-	// loop through all 9-mers
-	for (uint32_t i = 0; i < limit && !btrie.eof(); i++)
+	else
 	{
-		uint32_t sizeoftries[2] = { 0 };
-		char *dst = NULL; // ptr to block of memory for two mini-burst tries
-
-		// the size of both mini-burst tries
-		for (int j = 0; j < 2; j++)
+		// e.g. the file system does not support mapping. Read the whole part into
+		// a single heap arena instead, so that the unload is still a single free
+		WARN("Failed to map the index ", idxfile, " into memory: ", strerror(errno), ". Reading it into memory instead.");
+		addr = std::aligned_alloc(64, (map_size + 63) & ~static_cast<std::size_t>(63));
+		if (addr == nullptr)
 		{
-			btrie.read(reinterpret_cast<char*>(&sizeoftries[j]), sizeof(uint32_t));
+			ERR("Failed to allocate ", map_size, " bytes for the index ", idxfile);
+			exit(EXIT_FAILURE);
 		}
-
-		// allocate contiguous memory for both mini-burst tries if they exist
-		if (lookup_tbl[i].count != 0)
+		for (std::size_t done = 0; done < map_size; )
 		{
-			dst = new char[(sizeoftries[0] + sizeoftries[1])]();
-			if (dst == NULL)
+			ssize_t n = pread(fd, static_cast<char*>(addr) + done, map_size - done, done);
+			if (n <= 0)
 			{
-				std::stringstream ss;
-				ss << STAMP << "Failed to allocate memory for mini-burst tries";
-				ERR(ss.str())
+				ERR("Failed to read the index ", idxfile, ": ", strerror(errno));
 				exit(EXIT_FAILURE);
 			}
-			// load 2 burst tries per 9-mer
-			for (int j = 0; j < 2; j++)
-			{
-				// mini-burst trie exists
-				if (sizeoftries[j] != 0)
-				{
-					NodeElement newnode[4]; // create a root trie node
-					// copy the root trie node into the beginning of burst trie array
-					memcpy(dst, &newnode[0], sizeof(NodeElement) * 4);
-					memset(dst, 0, sizeof(NodeElement) * 4);
-					if (j == 0) lookup_tbl[i].trie_F = (NodeElement*)dst;
-					else lookup_tbl[i].trie_R = (NodeElement*)dst;
-					// queue to store the trie nodes as we create them
-					std::deque<NodeElement*> nodes;
-					nodes.push_back((NodeElement*)dst);
-					((NodeElement *&)dst) += 4;
-					// queue to store the flags of node elements given in the binary file
-					std::deque<char> flags;
-					// read the first trie node
-					for (int i = 0; i < 4; i++)
-					{
-						char tmp;
-						btrie.read(reinterpret_cast<char*>(&tmp), sizeof(char));
-						flags.push_back(tmp);
-					}
-					// build the mini-burst trie
-					while (!nodes.empty())
-					{
-						// ptr to traverse each trie node
-						NodeElement* node = nodes.front();
-						// trie node elements
-						for (int i = 0; i < 4; i++)
-						{
-							unsigned char flag = flags.front();
-							// what does the node element point to
-							switch (flag)
-							{
-								// set values to 0
-							case 0:
-							{
-								node->flag = 0;
-								node->size = 0;
-								node->nodetype.trie = NULL;
-							}
-							break;
-							// trie node
-							case 1:
-							{
-								// read the trie node
-								for (int i = 0; i < 4; i++)
-								{
-									char tmp;
-									btrie.read(reinterpret_cast<char*>(&tmp), sizeof(char));
-									flags.push_back(tmp);
-								}
-								node->flag = 1;
-								node->size = 0;
-								NodeElement newnode[4];
-								memcpy((NodeElement*)dst, &newnode[0], sizeof(NodeElement) * 4);
-								nodes.push_back((NodeElement*)dst);
-								node->nodetype.trie = (NodeElement*)dst;
-								((NodeElement *&)dst) += 4;
-							}
-							break;
-							// bucket
-							case 2:
-							{
-								uint32_t sizeofbucket = 0;
-								// read the bucket info
-								btrie.read(reinterpret_cast<char*>(&sizeofbucket), sizeof(uint32_t));
-
-								char* bucket = new char[sizeofbucket]();
-								if (bucket == NULL)
-								{
-									std::stringstream ss;
-									ss << STAMP << "Failed to allocate memory for allocate bucket";
-									fprintf(stderr, "\n  %sERROR%s:  (paralleltraversal.cpp)\n", RED, COLOFF);
-									exit(EXIT_FAILURE);
-								}
-								btrie.read(reinterpret_cast<char*>(bucket), sizeofbucket);
-								// copy the bucket into the burst trie array
-								memcpy((void*)dst, (void*)bucket, sizeofbucket);
-								delete[] bucket;
-								bucket = NULL;
-								// assign pointers from trie node to the bucket
-								node->flag = flag;
-								node->nodetype.bucket = dst;
-								node->size = sizeofbucket;
-								dst = ((char *)dst) + sizeofbucket;
-							}
-							break;
-							// ?
-							default:
-							{
-								fprintf(stderr, "\n  %sERROR%s: flag is set to %d (load_index)\n", RED, COLOFF, flag);
-								exit(EXIT_FAILURE);
-							}
-							break;
-							}
-							flags.pop_front();
-							node++;
-						}//~loop through 4 node elements in a trie node 
-						nodes.pop_front();
-					}//~while !nodes.empty()
-				}//~if mini-burst trie exists
-				else
-				{
-					if (j == 0) lookup_tbl[i].trie_F = NULL;
-					else lookup_tbl[i].trie_R = NULL;
-				}
-			}//~for both mini-burst tries
-		}//~if ( sizeoftries != 0 )
-		else
-		{
-			lookup_tbl[i].trie_F = NULL;
-			lookup_tbl[i].trie_R = NULL;
+			done += n;
 		}
-	}//~for all 9-mers in the look-up table
-	btrie.close();
-
-	// STEP 3: load the position reference tables (pos.dat)
-	std::string posfile = indexfiles[idx_num].second + ".pos_" + std::to_string(idx_part) + ".dat";
-	std::ifstream inreff(posfile, std::ios::in | std::ios::binary);
+		is_mapped = false;
+	}
+	close(fd);
+	map_addr = static_cast<const char*>(addr);
 
-	if (!inreff.good())
+	const IndexHeader* header = reinterpret_cast<const IndexHeader*>(map_addr);
+	if (std::memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 
+		|| header->version != INDEX_FORMAT_VERSION
+		|| header->file_size != map_size)
 	{
-		fprintf(stderr, "\n  ERROR: The database name '%s' does not exist.\n\n", posfile.c_str());
+		ERR("The index ", idxfile, " has unknown format (version ", header->version, ", expected ", INDEX_FORMAT_VERSION, 
+			") or is truncated. Please re-build the index.");
 		exit(EXIT_FAILURE);
 	}
 
-	uint32_t size = 0;
-	inreff.read(reinterpret_cast<char*>(&number_elements), sizeof(uint32_t));
-	positions_tbl.reserve(number_elements); // = new kmer_origin[number_elements]();
-
-	if (positions_tbl.capacity() == 0)
+	if (header->lnwin != refstats.lnwin[idx_num])
 	{
-		fprintf(stderr, "  ERROR: could not allocate memory for positions_tbl (main(), paralleltraversal.cpp)\n");
+		ERR("The index ", idxfile, " was built with seed length ", header->lnwin, 
+			" but its stats give ", refstats.lnwin[idx_num], ". Please re-build the index.");
 		exit(EXIT_FAILURE);
 	}
 
-	for (uint32_t i = 0; i < number_elements; i++)
+	// every section has to lie within the file and be aligned for its element type.
+	// The sections are used in place, so a damaged header would otherwise be read past the mapping
+	auto is_section = [this](uint64_t offset, uint64_t count, std::size_t elem_size, std::size_t align) {
+		return offset % align == 0 && offset <= map_size && count <= (map_size - offset) / elem_size;
+	};
+	bool is_valid = header->lnwin < 32
+		&& is_section(header->lookup_tbl_offset, 1ULL << header->lnwin, sizeof(FlatKmer), alignof(FlatKmer))
+		&& is_section(header->pos_dir_offset, header->number_elements + 1ULL, sizeof(uint64_t), alignof(uint64_t))
+		&& is_section(header->exact_offset, header->num_exact, sizeof(ExactKmer), alignof(ExactKmer))
+		&& header->num_exact <= UINT32_MAX
+		&& header->positions_offset <= header->exact_offset
+		&& is_section(header->tries_offset, 0, 1, alignof(FlatNodeElement));
+	if (is_valid)
 	{
-		/* the number of positions */
-		positions_tbl.push_back(kmer_origin());
-		inreff.read(reinterpret_cast<char*>(&size), sizeof(uint32_t));
-		positions_tbl[i].size = size;
-		/* the sequence seq_pos array */
-		positions_tbl[i].arr = new seq_pos[size]();
-		if (positions_tbl[i].arr == NULL)
+		// the positions directory points into the positions table, which ends where the exact L-mers start
+		const uint64_t* dir = reinterpret_cast<const uint64_t*>(map_addr + header->pos_dir_offset);
+		is_valid = dir[header->number_elements] <= header->exact_offset - header->positions_offset;
+	}
+	if (is_valid)
+	{
+		// the mini-burst tries are all after 'tries_offset'
+		const FlatKmer* tbl = reinterpret_cast<const FlatKmer*>(map_addr + header->lookup_tbl_offset);
+		for (uint64_t i = 0, n = 1ULL << header->lnwin; is_valid && i < n; ++i)
 		{
-			fprintf(stderr, "  ERROR: could not allocate memory for positions_tbl (paralleltraversal.cpp)\n");
-			exit(EXIT_FAILURE);
+			for (uint64_t trie : { tbl[i].trie_F, tbl[i].trie_R })
+			{
+				if (trie != 0 && (trie < header->tries_offset || !is_section(trie, 1, sizeof(FlatNodeElement), alignof(FlatNodeElement))))
+					is_valid = false;
+			}
+			// the exact L-mers of an L/2-mer end where the next L/2-mer's start (see 'find_exact')
+			if (tbl[i].exact > (i + 1 < n ? tbl[i + 1].exact : header->num_exact))
+				is_valid = false;
 		}
-		inreff.read(reinterpret_cast<char*>(positions_tbl[i].arr), sizeof(seq_pos)*size);
 	}
+	if (!is_valid)
+	{
+		ERR("The index ", idxfile, " is corrupt: a section is out of the file bounds or misaligned. Please re-build the index.");
+		exit(EXIT_FAILURE);
+	}
+
+	lookup_tbl_size = 1 << header->lnwin;
+	lookup_tbl = reinterpret_cast<const FlatKmer*>(map_addr + header->lookup_tbl_offset);
+	number_elements = header->number_elements;
+	pos_dir = reinterpret_cast<const uint64_t*>(map_addr + header->pos_dir_offset);
+	positions_tbl = reinterpret_cast<const uint8_t*>(map_addr + header->positions_offset);
+	exact_tbl = reinterpret_cast<const ExactKmer*>(map_addr + header->exact_offset);
+	num_exact = static_cast<uint32_t>(header->num_exact);
 
-	inreff.close();
 	index_num = idx_num;
 	part = idx_part;
 } // ~Index::load
 
 void Index::unload()
 {
-	// lookup_tbl
-	for (std::size_t i = 0; i < lookup_tbl.size(); i++)
+	if (map_addr != nullptr)
 	{
-		if (lookup_tbl[i].trie_F != NULL)
-		{
-			delete[] lookup_tbl[i].trie_F;
-			lookup_tbl[i].trie_F = NULL;
-			lookup_tbl[i].trie_R = NULL;
-		}
-		if (lookup_tbl[i].trie_R != NULL)
-		{
-			delete[] lookup_tbl[i].trie_R;
-			lookup_tbl[i].trie_R = NULL;
-		}
-	}
-	lookup_tbl.clear();
-
-	// positions_tbl
-	for (std::size_t i = 0; i < positions_tbl.size(); i++)
-	{
-		if (positions_tbl[i].arr != NULL)
-		{
-			delete[] positions_tbl[i].arr;
-			positions_tbl[i].arr = NULL;
-		}
+		if (is_mapped)
+			munmap(const_cast<char*>(map_addr), map_size);
+		else
+			std::free(const_cast<char*>(map_addr));
+		map_addr = nullptr;
+		map_size = 0;
 	}
-	positions_tbl.clear();
-} // ~Index::clear
+	lookup_tbl = nullptr;
+	lookup_tbl_size = 0;
+	pos_dir = nullptr;
+	positions_tbl = nullptr;
+	exact_tbl = nullptr;
+	num_exact = 0;
+	number_elements = 0;
+} // ~Index::unload
+
+void Index::prefault() const
+{
+	if (map_addr == nullptr) return;
+	const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	volatile char sink = 0;
+	for (std::size_t off = 0; off < map_size; off += page)
+		sink = sink + map_addr[off];
+	(void)sink;
+} // ~Index::prefault
@@ -42,7 +42,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include <cassert>
 #include <string>
 #include <vector>
-#include <deque>
+#include <map>
 #include <sstream>
 #include <fstream>
 #include <iomanip>
@@ -52,6 +52,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <filesystem>
 #include <chrono>
+#include <thread>
 
 #include <sys/stat.h> //for creating tmp dir
 
@@ -61,6 +62,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include "BooPHF.h"
 #include "options.hpp"
 
+using boophf_t = boomphf::mphf<uint64_t, boomphf::SingleHashFunctor<uint64_t>>;
 
 //! burst trie nucleotide map
 /*! the trie nodes consist of an array holding four
@@ -695,171 +697,260 @@ void traversetrie_debug(NodeElement* trie_node, uint32_t depth, uint32_t &total_
 
 /*
  *
- * @function load index: write to binary file the 9-mer look-up
- * tables and the mini-burst tries
- * @param string root: the file name of the index
- * @param kmer* lookup_table: pointer to the 9-mer lookup table
+ * @function flatten_node: serialize the trie node 'node' (4 node elements) at the
+ * offset 'node_off' of 'buf', followed by the sub-tries and buckets of its elements
+ * in the order 'traversetrie_align' visits them (A, C, G, T depth-first)
+ * @param NodeElement* node: trie node (array of 4 node elements)
+ * @param std::size_t node_off: offset of the flat copy of the node in 'buf', already allocated
+ * @param std::vector<char>& buf: OUT the flat image of the trie
  * @return void
- * @version 1.0 Jan 16, 2013
  *
  *******************************************************************/
-void load_index(kmer* lookup_table, char* outfile, Runopts &opts)
+static void flatten_node(NodeElement* node, std::size_t node_off, std::vector<char>& buf)
 {
-	// output the mini-burst tries
-	std::ofstream btrie(outfile, std::ofstream::binary);
+	for (std::size_t i = 0; i < 4; i++)
+	{
+		std::size_t elem_off = node_off + i * sizeof(FlatNodeElement);
+		FlatNodeElement elem = { 0, 0, static_cast<uint32_t>(node[i].flag) };
+		switch (node[i].flag)
+		{
+		// empty node
+		case 0:
+			break;
+		// trie node, the child trie node and its sub-tries follow immediately
+		case 1:
+		{
+			std::size_t child_off = buf.size();
+			buf.resize(child_off + 4 * sizeof(FlatNodeElement), 0);
+			elem.offset = static_cast<uint32_t>(child_off - elem_off);
+			flatten_node(node[i].nodetype.trie, child_off, buf);
+		}
+		break;
+		// bucket node, copy the bucket
+		case 2:
+		{
+			std::size_t bucket_off = buf.size();
+			char* bucket = (char*)node[i].nodetype.bucket;
+			buf.insert(buf.end(), bucket, bucket + node[i].size);
+			elem.offset = static_cast<uint32_t>(bucket_off - elem_off);
+			elem.size = node[i].size;
+		}
+		break;
+		default:
+		{
+			ERR("flag is set to ", (int)node[i].flag, " (flatten_node)");
+			exit(EXIT_FAILURE);
+		}
+		}
+		std::memcpy(&buf[elem_off], &elem, sizeof(FlatNodeElement));
+	}
+}//~flatten_node()
 
-	uint32_t sizeoftries[2] = { 0 };
+/*
+ *
+ * @function flatten_trie: serialize a mini-burst trie into a flat image
+ * laid out in the traversal order, where every node element refers to its
+ * child trie node or bucket by an offset relative to itself
+ * @param NodeElement* trie_node: root of the mini-burst trie
+ * @param std::vector<char>& buf: OUT the flat image of the trie
+ * @return void
+ *
+ *******************************************************************/
+void flatten_trie(NodeElement* trie_node, std::vector<char>& buf)
+{
+	buf.assign(4 * sizeof(FlatNodeElement), 0);
+	flatten_node(trie_node, 0, buf);
 
-	// loop through all 9-mers
-	for (uint32_t i = 0; i < (uint32_t)(1 << opts.seed_win_len); i++)
+	if (buf.size() > UINT32_MAX)
 	{
-		NodeElement* trienode = NULL;
-
-#ifdef see_binary_output
-		cout << "9-mer = " << i; //TESTING
-#endif
+		ERR("mini-burst trie of size ", buf.size(), " bytes cannot be addressed with 32-bit offsets (flatten_trie)");
+		exit(EXIT_FAILURE);
+	}
+}//~flatten_trie()
 
-	// 1. output size for the two mini-burst tries for each 9-mer
-		for (int j = 0; j < 2; j++)
+/*
+ *
+ * @function collect_exact: collect the exact L-mers of a forward mini-burst trie
+ * in the order 'traversetrie_align' visits them (A, C, G, T depth-first)
+ * @param NodeElement* node: trie node (array of 4 node elements)
+ * @param uint32_t depth: number of the tail nucleotides consumed by the trie nodes above 'node'
+ * @param uint32_t tail: the consumed nucleotides, 2 bits per nt, the first nt in the highest bits
+ * @param std::vector<ExactKmer>& exact: OUT
+ * @return void
+ *
+ *******************************************************************/
+static void collect_exact(NodeElement* node, uint32_t depth, uint32_t tail, std::vector<ExactKmer>& exact)
+{
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		uint32_t tail_i = (tail << 2) | i;
+		if (node[i].flag == 1)
+		{
+			collect_exact(node[i].nodetype.trie, depth + 1, tail_i, exact);
+		}
+		else if (node[i].flag == 2)
 		{
-			total_num_trie_nodes = 0;
-			size_of_all_buckets = 0;
-			if (j == 0) trienode = lookup_table[i].trie_F;
-			else trienode = lookup_table[i].trie_R;
+			const unsigned char* entry = (const unsigned char*)node[i].nodetype.bucket;
+			const unsigned char* end = entry + node[i].size;
+			for (; entry != end; entry += ENTRYSIZE)
+			{
+				// the bucket entry holds the rest of the tail, the first nt in the lowest bits
+				uint32_t entry_str = *((const uint32_t*)entry);
+				uint32_t kmer = tail_i;
+				for (uint32_t j = depth + 1; j < partialwin_gv; j++, entry_str >>= 2)
+					kmer = (kmer << 2) | (entry_str & 3);
+				exact.push_back({ kmer, *((const uint32_t*)entry + 1) });
+			}
+		}
+	}
+}//~collect_exact()
 
-			if (trienode != NULL) traversetrie(trienode, 0);
 
-			sizeoftrie = total_num_trie_nodes * sizeof(NodeElement) * 4 + size_of_all_buckets * sizeof(char);
-			sizeoftries[j] = sizeoftrie;
-			btrie.write(reinterpret_cast<const char*>(&sizeoftrie), sizeof(uint32_t));
 
-#ifdef see_binary_output
-			if (j == 0) cout << "\tsizeoftrie f = " << sizeoftrie; //TESTING
-			else cout << "\tsizeoftrie r = " << sizeoftrie; //TESTING
-#endif
-		}
+/*
+ *
+ * @function write_index_part: write an index part into a single flat
+ * binary file that Index::load maps into memory as is (see IndexHeader)
+ * @param std::string& idx_file: the file name of the index part
+ * @param kmer* lookup_table: the 9-mer lookup table and mini-burst tries
+ * @param kmer_origin* positions_tbl: the positions table
+ * @param uint32_t number_elements: number of entries in the positions table
+ * @param uint64_t& positions_bytes: OUT size of the encoded positions table
+ * @return uint64_t: size of the written file
+ *
+ *******************************************************************/
+uint64_t write_index_part(std::string& idx_file, kmer* lookup_table, kmer_origin* positions_tbl, uint32_t number_elements, uint64_t& positions_bytes, Runopts& opts)
+{
+	std::ofstream os(idx_file, std::ios::binary);
+	if (!os.is_open())
+	{
+		ERR("Failed to open file: ", idx_file, " for writing. Error: ", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-#ifdef see_binary_output
-		cout << "\tlookup_tbl[i].count = " << lookup_table[i].count << endl; //TESTING
-#endif        
-	// 2. output both mini-burst tries into binary file
-		for (int j = 0; j < 2; j++)
+	uint32_t lookup_size = 1 << opts.seed_win_len;
+
+	IndexHeader header;
+	std::memset(&header, 0, sizeof(IndexHeader));
+	std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	header.version = INDEX_FORMAT_VERSION;
+	header.lnwin = opts.seed_win_len;
+	header.number_elements = number_elements;
+
+	// encode the positions: sort each (L+1)-mer's positions by reference and position,
+	// group them by reference, and store the deltas as varints
+	std::vector<uint64_t> pos_dir(number_elements + 1ULL);
+	std::vector<uint8_t> positions;
+	std::vector<seq_pos> sorted;
+	for (uint32_t j = 0; j < number_elements; j++)
+	{
+		pos_dir[j] = positions.size();
+		header.num_positions += positions_tbl[j].size;
+		if (positions_tbl[j].size > header.max_positions)
+			header.max_positions = positions_tbl[j].size;
+
+		sorted.assign(positions_tbl[j].arr, positions_tbl[j].arr + positions_tbl[j].size);
+		std::sort(sorted.begin(), sorted.end(), [](const seq_pos& a, const seq_pos& b) {
+			return a.seq != b.seq ? a.seq < b.seq : a.pos < b.pos;
+		});
+		uint32_t prev_seq = 0;
+		for (std::size_t k = 0; k < sorted.size(); )
 		{
-			// the mini-burst trie exists, load into memory
-			if (sizeoftries[j] != 0)
+			std::size_t group_end = k;
+			while (group_end < sorted.size() && sorted[group_end].seq == sorted[k].seq)
+				++group_end;
+			put_varint(positions, sorted[k].seq - prev_seq);
+			put_varint(positions, static_cast<uint32_t>(group_end - k));
+			prev_seq = sorted[k].seq;
+			for (uint32_t prev_pos = 0; k < group_end; ++k)
 			{
-				if (j == 0)
-				{
-					trienode = lookup_table[i].trie_F;
-#ifdef see_binary_output
-					cout << "forward burst-trie \n"; //TESTING
-#endif
-				}
-				else
-				{
-					trienode = lookup_table[i].trie_R;
-#ifdef see_binary_output
-					cout << "reverse burst-trie \n"; //TESTING
-#endif
-				}
-
-				// queue of node elements for breadth-first traversal
-				std::deque<NodeElement*> nodes;
+				put_varint(positions, sorted[k].pos - prev_pos);
+				prev_pos = sorted[k].pos;
+			}
+		}
+	}
+	pos_dir[number_elements] = positions.size();
+	positions.resize((positions.size() + 7) & ~static_cast<std::size_t>(7), 0); // keep the tries 8-byte aligned
+
+	// exact L-mers of the forward tries, sorted by the second L/2-mer. Of the (L+1)-mers
+	// sharing an L-mer the first in the traversal order is kept (stable sort)
+	std::vector<FlatKmer> flat_lookup(lookup_size);
+	std::vector<ExactKmer> exact;
+	for (uint32_t i = 0; i < lookup_size; i++)
+	{
+		flat_lookup[i].exact = static_cast<uint32_t>(exact.size());
+		if (lookup_table[i].trie_F == NULL) continue;
+		auto first = exact.size();
+		collect_exact(lookup_table[i].trie_F, 0, 0, exact);
+		auto by_tail = [](const ExactKmer& a, const ExactKmer& b) { return a.tail < b.tail; };
+		std::stable_sort(exact.begin() + first, exact.end(), by_tail);
+		exact.erase(std::unique(exact.begin() + first, exact.end(), [](const ExactKmer& a, const ExactKmer& b) {
+			return a.tail == b.tail; }), exact.end());
+	}
+	header.num_exact = exact.size();
 
-				// load first set of NodeElements into the queue & write to file
-				for (int i = 0; i < 4; i++)
-				{
-					nodes.push_back(trienode);
-					btrie.write(reinterpret_cast<const char*>(&(trienode->flag)), sizeof(char));
-#ifdef see_binary_output
-					cout << " " << (int)trienode->flag; //TESTING
-#endif
-					trienode++;
-				}
+	header.lookup_tbl_offset = sizeof(IndexHeader);
+	header.pos_dir_offset = header.lookup_tbl_offset + lookup_size * sizeof(FlatKmer);
+	header.positions_offset = header.pos_dir_offset + (number_elements + 1ULL) * sizeof(uint64_t);
+	header.exact_offset = header.positions_offset + positions.size();
+	header.tries_offset = header.exact_offset + exact.size() * sizeof(ExactKmer);
 
-				int depth = 0;
-				int poplimit = 4;
-				int numpops = 0;
-				int topop = 0;
+	// memory report: the compact positions vs. a fixed size 'seq_pos' per position
+	positions_bytes = positions.size();
+	if (opts.is_verbose)
+	{
+		uint64_t flat_bytes = header.num_positions * sizeof(seq_pos);
+		INFO_NS("      positions table: ", header.num_positions, " positions in ", positions_bytes, " bytes, ",
+			flat_bytes, " bytes as fixed size (", sizeof(seq_pos), " bytes) entries, ratio ",
+			flat_bytes > 0 ? static_cast<double>(positions_bytes) / flat_bytes : 0.0, "\n");
+	}
 
-				while (!nodes.empty())
-				{
-					// increment depth of burst trie
-					if (numpops == poplimit)
-					{
-						depth++;
-						poplimit = topop;
-						numpops = 0;
-						topop = 0;
-					}
+	// 1. the header and the look-up table, written again once the trie offsets are known
+	os.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+	os.write(reinterpret_cast<const char*>(flat_lookup.data()), lookup_size * sizeof(FlatKmer));
 
-					trienode = nodes.front();
+	// 2. positions directory
+	os.write(reinterpret_cast<const char*>(pos_dir.data()), pos_dir.size() * sizeof(uint64_t));
 
-					switch (trienode->flag)
-					{
-						// empty node
-					case 0:
-					{
-						;
-					}
-					break;
-					// trie node, add child trie node to queue
-					case 1:
-					{
-						NodeElement *child = trienode->nodetype.trie;
-						for (int i = 0; i < 4; i++)
-						{
-							nodes.push_back(child);
-							btrie.write(reinterpret_cast<const char*>(&(child->flag)), sizeof(char));
-#ifdef see_binary_output
-							cout << " " << (int)child->flag; //TESTING
-#endif
-							child++;
-						}
-						topop += 4;
-					}
-					break;
-					// bucket node, add bucket to output file
-					case 2:
-					{
-						char* bucket = (char*)(trienode->nodetype.bucket);
+	// 3. positions table
+	os.write(reinterpret_cast<const char*>(positions.data()), positions.size());
 
-						// bucket information
-						uint32_t sizeofbucket = trienode->size;
+	// 4. exact L-mers
+	os.write(reinterpret_cast<const char*>(exact.data()), exact.size() * sizeof(ExactKmer));
 
-#ifdef see_binary_output
-						cout << "\tsizeofbucket = " << sizeofbucket; //TESTING
-#endif                 
-						btrie.write(reinterpret_cast<const char*>(&sizeofbucket), sizeof(uint32_t));
-
-						// bucket content
-						char* start = (char*)bucket;
+	// 5. mini-burst tries
+	uint64_t offset = header.tries_offset;
+	std::vector<char> buf;
+	for (uint32_t i = 0; i < lookup_size; i++)
+	{
+		flat_lookup[i].count = lookup_table[i].count;
+		for (int j = 0; j < 2; j++)
+		{
+			NodeElement* trienode = j == 0 ? lookup_table[i].trie_F : lookup_table[i].trie_R;
+			if (trienode == NULL) continue;
+
+			flatten_trie(trienode, buf);
+			os.write(buf.data(), buf.size());
+			if (j == 0) flat_lookup[i].trie_F = offset;
+			else flat_lookup[i].trie_R = offset;
+			offset += buf.size();
+		}
+	}
+	header.file_size = offset;
 
-						btrie.write(reinterpret_cast<const char*>(start), sizeofbucket);
-					}
-					break;
-					// ?
-					default:
-					{
-						std::cerr << RED << "  ERROR" << COLOFF 
-							<<": flag is set to " << trienode->flag << " (load_index)" << std::endl;
-						exit(EXIT_FAILURE);
-					}
-					break;
-					}
+	os.seekp(0);
+	os.write(reinterpret_cast<const char*>(&header), sizeof(IndexHeader));
+	os.write(reinterpret_cast<const char*>(flat_lookup.data()), lookup_size * sizeof(FlatKmer));
+	os.close();
 
-					nodes.pop_front();
-					numpops++;
+	if (!os.good())
+	{
+		ERR("Failed writing index file: ", idx_file, " Error: ", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-#ifdef see_binary_output
-					if (numpops % 4 == 0) cout << "\n"; //TESTING
-#endif             
-				}//~while the queue is not empty
-			}//~if mini-burst trie exists
-		}//~for each mini-burst trie in the 9-mer
-	}//~for each 9-mer
-	btrie.close();
-}//~load_index()
+	return header.file_size;
+}//~write_index_part()
 
 
 
@@ -975,6 +1066,242 @@ namespace {
 }
 
 
+/*
+ *
+ * @function insert_kmers: build thread of the index part. Insert the 19-mers
+ * of all the part's sequences into the mini-burst tries of the 9-mers owned by
+ * the thread i.e. the 9-mers with 'key % num_threads == thread'. The sequences
+ * are scanned in order, so each mini-burst trie is built as in a serial build.
+ * @param uint32_t thread: the build thread number
+ * @param uint32_t num_threads: number of the build threads
+ * @param part_seqs: the part's sequences encoded using integer alphabet {0,1,2,3}
+ * @param kmer* lookup_table: the 9-mer look-up table
+ * @param incremented_by_forward: flags which 9-mers were counted by the forward window
+ * @param keys: OUT <window number in the part, 18-mer> for each 18-mer first seen by the thread
+ * @return void
+ *
+ *******************************************************************/
+void insert_kmers(uint32_t thread, uint32_t num_threads,
+	std::vector<std::vector<unsigned char>>& part_seqs,
+	kmer* lookup_table,
+	std::vector<uint8_t>& incremented_by_forward,
+	std::vector<std::pair<uint64_t, uint64_t>>& keys,
+	Runopts& opts)
+{
+	uint64_t win_num = 0; // number of the 19-mer window in the part
+	std::vector<unsigned char> myseqr;
+
+	for (auto& seq : part_seqs)
+	{
+		unsigned char* myseq = seq.data();
+		uint32_t len = static_cast<uint32_t>(seq.size());
+
+		// create a reverse sequence using the forward
+		myseqr.assign(seq.rbegin(), seq.rend());
+
+		// 9-mer prefix of 19-mer
+		uint32_t kmer_key_short_f = 0;
+		// 9-mer suffix of 19-mer i.e. prefix of the reversed seq
+		uint32_t kmer_key_short_r = 0;
+		// pointer to next letter to add to 9-mer prefix
+		unsigned char* kmer_key_short_f_p = &myseq[0];
+		// pointer to next letter to add to 9-mer suffix
+		unsigned char* kmer_key_short_r_p = &myseq[partialwin_gv + 1];
+		// pointer to 10-mer of reverse 19-mer to insert
+		// into the mini-burst trie
+		unsigned char* kmer_key_short_r_rp = &myseqr[len - partialwin_gv - 1];
+		// 19-mer
+		unsigned long long int kmer_key = 0;
+		// pointer to 19-mer
+		unsigned char* kmer_key_ptr = &myseq[0];
+
+		// initialize the prefix and suffix 9-mers
+		for (uint32_t j = 0; j < partialwin_gv; j++)
+		{
+			(kmer_key_short_f <<= 2) |= (int)*kmer_key_short_f_p++;
+			(kmer_key_short_r <<= 2) |= (int)*kmer_key_short_r_p++;
+		}
+
+		// initialize the 19-mer
+		for (uint32_t j = 0; j < pread_gv; j++) (kmer_key <<= 2) |= (int)*kmer_key_ptr++;
+
+		uint32_t numwin = (len - pread_gv + opts.interval) / opts.interval;
+
+		// for all 19-mers on the sequence
+		for (uint32_t j = 0; j < numwin; j++, win_num++)
+		{
+			// ****** add the forward 19-mer
+			if (kmer_key_short_f % num_threads == thread)
+			{
+				lookup_table[kmer_key_short_f].count++;
+				incremented_by_forward[kmer_key_short_f] = 1;
+
+				// new position for 18-mer in positions_tbl
+				bool new_position = true;
+
+				// forward 19-mer does not exist in the burst trie (duplicates not allowed)
+				if (lookup_table[kmer_key_short_f].trie_F == NULL ||
+					!search_burst_trie(lookup_table[kmer_key_short_f].trie_F, kmer_key_short_f_p, new_position))
+				{
+					// create a trie node if it doesn't exist
+					if (lookup_table[kmer_key_short_f].trie_F == NULL)
+					{
+						lookup_table[kmer_key_short_f].trie_F = (NodeElement*)malloc(4 * sizeof(NodeElement));
+						if (lookup_table[kmer_key_short_f].trie_F == NULL)
+						{
+							ERR("could not allocate memory for trie_node in indexdb.cpp");
+							exit(EXIT_FAILURE);
+						}
+						memset(lookup_table[kmer_key_short_f].trie_F, 0, 4 * sizeof(NodeElement));
+					}
+
+					insert_prefix(lookup_table[kmer_key_short_f].trie_F, kmer_key_short_f_p);
+				}
+
+				// 18-mer doesn't exist in the burst trie, add it to keys
+				if (new_position)
+					keys.push_back({ win_num, kmer_key >> 2 });
+			}
+
+			// ****** add the reverse 19-mer
+			if (kmer_key_short_r % num_threads == thread)
+			{
+				// increment 9-mer count only if it wasn't already
+				// incremented by kmer_key_short_f before
+				if (!incremented_by_forward[kmer_key_short_r]) {
+					lookup_table[kmer_key_short_r].count++;
+				}
+
+				bool new_position = true;
+
+				// reverse 19-mer does not exist in the burst trie
+				if (lookup_table[kmer_key_short_r].trie_R == NULL ||
+					!search_burst_trie(lookup_table[kmer_key_short_r].trie_R, kmer_key_short_r_rp, new_position))
+				{
+					// create a trie node if it doesn't exist
+					if (lookup_table[kmer_key_short_r].trie_R == NULL)
+					{
+						lookup_table[kmer_key_short_r].trie_R = (NodeElement*)malloc(4 * sizeof(NodeElement));
+						if (lookup_table[kmer_key_short_r].trie_R == NULL)
+						{
+							ERR("could not allocate memory for trie_node in indexdb.cpp");
+							exit(EXIT_FAILURE);
+						}
+						memset(lookup_table[kmer_key_short_r].trie_R, 0, 4 * sizeof(NodeElement));
+					}
+
+					insert_prefix(lookup_table[kmer_key_short_r].trie_R, kmer_key_short_r_rp);
+				}
+			}
+
+			// shift 19-mer window and both 9-mers
+			if (j != numwin - 1)
+			{
+				for (uint32_t shift = 0; shift < opts.interval; shift++)
+				{
+					((kmer_key_short_f <<= 2) &= mask32) |= (int)*kmer_key_short_f_p++;
+					((kmer_key_short_r <<= 2) &= mask32) |= (int)*kmer_key_short_r_p++;
+					((kmer_key <<= 2) &= mask64) |= (int)*kmer_key_ptr++;
+					kmer_key_short_r_rp--;
+				}
+			}
+		}//~for all 19-mers on the sequence
+	}//~for all sequences
+}//~insert_kmers()
+
+
+
+/*
+ *
+ * @function add_ids_and_positions: build thread of the index part. Set the
+ * MPHF ids of the 19-mers in the mini-burst tries of the 9-mers owned by the
+ * thread (see insert_kmers) and fill the positions of these 19-mers.
+ * All occurrences of an 18-mer share the 9-mer prefix, hence every positions
+ * table entry is filled by a single thread in the sequence order.
+ * @return void
+ *
+ *******************************************************************/
+void add_ids_and_positions(uint32_t thread, uint32_t num_threads,
+	std::vector<std::vector<unsigned char>>& part_seqs,
+	kmer* lookup_table,
+	boophf_t* hash,
+	kmer_origin* positions_tbl,
+	uint32_t number_elements,
+	Runopts& opts)
+{
+	std::vector<unsigned char> myseqr;
+
+	// sequence number
+	for (uint32_t i = 0; i < part_seqs.size(); i++)
+	{
+		unsigned char* myseq = part_seqs[i].data();
+		uint32_t len = static_cast<uint32_t>(part_seqs[i].size());
+
+		// create a reverse sequence using the forward
+		myseqr.assign(part_seqs[i].rbegin(), part_seqs[i].rend());
+
+		uint32_t kmer_key_short_f = 0;
+		uint32_t kmer_key_short_r = 0;
+		unsigned char* kmer_key_short_f_p = &myseq[0];
+		unsigned char* kmer_key_short_r_p = &myseq[partialwin_gv + 1];
+		unsigned char* kmer_key_short_r_rp = &myseqr[len - partialwin_gv - 1];
+		unsigned long long int kmer_key = 0;
+		unsigned char* kmer_key_ptr = &myseq[0];
+
+		// initialize the 9-mers
+		for (uint32_t j = 0; j < partialwin_gv; j++)
+		{
+			(kmer_key_short_f <<= 2) |= (int)*kmer_key_short_f_p++;
+			(kmer_key_short_r <<= 2) |= (int)*kmer_key_short_r_p++;
+		}
+
+		// initialize the 19-mer
+		for (uint32_t j = 0; j < pread_gv; j++)
+			(kmer_key <<= 2) |= (int)*kmer_key_ptr++;
+
+		uint32_t numwin = (len - pread_gv + opts.interval) / opts.interval;
+		uint32_t index_pos = 0;
+
+		// for all 19-mers on the sequence
+		for (uint32_t j = 0; j < numwin; j++)
+		{
+			bool is_own_f = kmer_key_short_f % num_threads == thread;
+			bool is_own_r = kmer_key_short_r % num_threads == thread;
+
+			if (is_own_f || is_own_r)
+			{
+				// Bug 1 check: BBHash silently returns a false-positive for absent keys
+				uint64_t raw_id = hash->lookup(kmer_key >> 2);
+				assert(raw_id < number_elements && "BBHash lookup returned out-of-range id - key not in MPHF");
+				uint32_t id = static_cast<uint32_t>(raw_id);
+
+				if (is_own_f)
+				{
+					add_id_to_burst_trie(lookup_table[kmer_key_short_f].trie_F, kmer_key_short_f_p, id);
+					add_kmer_to_table(positions_tbl + id, i, index_pos, opts.max_pos);
+				}
+				if (is_own_r)
+					add_id_to_burst_trie(lookup_table[kmer_key_short_r].trie_R, kmer_key_short_r_rp, id);
+			}
+
+			// shift the 19-mer and 9-mers
+			if (j != numwin - 1)
+			{
+				for (uint32_t shift = 0; shift < opts.interval; shift++)
+				{
+					((kmer_key_short_f <<= 2) &= mask32) |= (int)*kmer_key_short_f_p++;
+					((kmer_key_short_r <<= 2) &= mask32) |= (int)*kmer_key_short_r_p++;
+					((kmer_key <<= 2) &= mask64) |= (int)*kmer_key_ptr++;
+					kmer_key_short_r_rp--;
+					index_pos++;
+				}
+			}
+		}
+	}//~for all sequences
+}//~add_ids_and_positions()
+
+
+
 // Per-partition statistics collected while writing index binary files.
 // Written to *.idx_stats.yaml alongside the binary index files.
 struct idx_yaml_part {
@@ -986,12 +1313,126 @@ struct idx_yaml_part {
 	uint32_t pos_num_elements;
 	uint64_t pos_total_positions;
 	uint32_t pos_max_positions;
-	uint64_t kmer_file_bytes;
-	uint64_t bursttrie_file_bytes;
-	uint64_t pos_file_bytes;
+	uint64_t pos_bytes; // size of the encoded positions table
+	uint64_t idx_file_bytes;
 };
 
-int build_index(Runopts& opts)
+/* modification time of the file in the ticks of the file clock (not the Unix time), 0 if not known */
+static int64_t file_mtime(const std::string& file)
+{
+	std::error_code ec;
+	auto mtime = std::filesystem::last_write_time(file, ec);
+	return ec ? 0 : static_cast<int64_t>(mtime.time_since_epoch().count());
+}
+
+/* text of the descriptor, one 'key: value' per line */
+static std::string descriptor_text(uint64_t hash, uint64_t size, int64_t mtime, Runopts& opts)
+{
+	std::stringstream ss;
+	ss << "format_version: " << INDEX_FORMAT_VERSION << "\n"
+		<< "reference_hash: " << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << "\n"
+		<< "reference_size: " << size << "\n"
+		<< "reference_mtime: " << mtime << "\n"
+		<< "seed_win_len: " << opts.seed_win_len << "\n"
+		<< "interval: " << opts.interval << "\n"
+		<< "max_pos: " << opts.max_pos << "\n";
+	return ss.str();
+}
+
+/* the lines 'key: value' of a descriptor */
+static std::map<std::string, std::string> parse_descriptor(const std::string& desc)
+{
+	std::map<std::string, std::string> vals;
+	std::istringstream iss(desc);
+	for (std::string line; std::getline(iss, line); )
+	{
+		auto pos = line.find(": ");
+		if (pos != std::string::npos)
+			vals[line.substr(0, pos)] = line.substr(pos + 2);
+	}
+	return vals;
+}
+
+/*
+ *
+ * @function index_descriptor: see INDEX_DESC_SFX
+ * @param std::string& ref_file: the reference file
+ * @return std::string: the descriptor, one 'key: value' per line
+ *
+ *******************************************************************/
+std::string index_descriptor(const std::string& ref_file, Runopts& opts)
+{
+	std::ifstream ifs(ref_file, std::ios::binary);
+	if (!ifs.is_open())
+	{
+		ERR("Could not open file: ", ref_file);
+		exit(EXIT_FAILURE);
+	}
+	auto mtime = file_mtime(ref_file); // prior reading, a change while hashing shows on the next run
+
+	// 64-bit FNV-1a of the file content
+	uint64_t hash = 14695981039346656037ULL;
+	uint64_t size = 0;
+	std::vector<char> buf(1 << 20);
+	while (ifs)
+	{
+		ifs.read(buf.data(), buf.size());
+		auto n = ifs.gcount();
+		for (std::streamsize i = 0; i < n; ++i)
+		{
+			hash ^= static_cast<unsigned char>(buf[i]);
+			hash *= 1099511628211ULL;
+		}
+		size += n;
+	}
+
+	return descriptor_text(hash, size, mtime, opts);
+}//~index_descriptor()
+
+bool is_index_current(const std::string& ref_file, const std::string& idx_prefix, Runopts& opts)
+{
+	std::error_code ec;
+	auto size = std::filesystem::file_size(ref_file, ec);
+	if (ec)
+	{
+		ERR("Could not open file: ", ref_file, ": ", ec.message());
+		exit(EXIT_FAILURE);
+	}
+
+	std::ifstream desc_strm(idx_prefix + INDEX_DESC_SFX, std::ios::binary);
+	std::string desc((std::istreambuf_iterator<char>(desc_strm)), std::istreambuf_iterator<char>());
+	desc_strm.close();
+	auto stored = parse_descriptor(desc);
+	if (stored.count("reference_hash") == 0)
+		return false;
+
+	// all but the hash
+	auto current = parse_descriptor(descriptor_text(0, size, file_mtime(ref_file), opts));
+	current.erase("reference_hash");
+	auto is_same = [&stored, &current](bool is_mtime) {
+		for (auto const& kv : current)
+		{
+			if (!is_mtime && kv.first == "reference_mtime") continue;
+			auto it = stored.find(kv.first);
+			if (it == stored.end() || it->second != kv.second) return false;
+		}
+		return true;
+	};
+	if (is_same(true))
+		return true;
+	if (!is_same(false))
+		return false; // the size or the parameters changed
+
+	// same size, but touched or copied. Compare the content
+	auto desc_now = index_descriptor(ref_file, opts);
+	if (parse_descriptor(desc_now)["reference_hash"] != stored["reference_hash"])
+		return false;
+	std::ofstream desc_out(idx_prefix + INDEX_DESC_SFX, std::ios::binary);
+	desc_out << desc_now; // the next run matches on the time
+	return true;
+}//~is_index_current
+
+int build_index(Runopts& opts, const std::vector<std::size_t>& idx_to_build)
 {
 	std::stringstream ss;
 	auto stt = std::chrono::high_resolution_clock::now();
@@ -1024,10 +1465,13 @@ int build_index(Runopts& opts)
 		INFO_NS("\n  Total number of databases to index: ", opts.indexfiles.size(), "\n\n");
 	}
 
-	// build index for each pair in indexfiles vector
+	// build index for each requested pair in indexfiles vector
 	// Split the index into smaller parts when 'opts.max_file_size' is exceeded
-	for (auto idxpair: opts.indexfiles)
+	for (auto idx: idx_to_build)
 	{
+		auto idxpair = opts.indexfiles[idx];
+		// describe the reference as it is now, prior reading it for indexing
+		std::string descriptor = index_descriptor(idxpair.first, opts);
 		std::vector< std::pair<std::string, uint32_t> > sam_sq_header;
 
 		// vector of structs storing information on which sequences from
@@ -1187,9 +1631,12 @@ int build_index(Runopts& opts)
 			}
 
 			memset(lookup_table, 0, (1 << opts.seed_win_len) * sizeof(kmer));
-			// bool vector to keep track which L/2-mers have been counted for
-			// by the forward sliding L/2-mer window
-			std::vector<bool> incremented_by_forward((1 << opts.seed_win_len));
+			// flags which L/2-mers have been counted for by the forward sliding L/2-mer window.
+			// One byte per L/2-mer as the flags are set concurrently by the build threads
+			std::vector<uint8_t> incremented_by_forward((1 << opts.seed_win_len));
+
+			// reference sequences of the part encoded using integer alphabet {0,1,2,3}
+			std::vector<std::vector<unsigned char>> part_seqs;
 
 			// total size of index so far in bytes
 			index_size = 0;
@@ -1213,7 +1660,7 @@ int build_index(Runopts& opts)
 			// on a read matches exactly to the prefix or suffix of a 19-mer in the
 			// mini-burst trie, we need to recover all of the 18-mer occurrences in the database
 			//
-			// read the reads file char by char
+			// read the reference sequences of the part char by char
 			do
 			{
 				long int start_seq = ftell(fp); // start of current sequence in file
@@ -1222,9 +1669,8 @@ int build_index(Runopts& opts)
 				// scan to end of header name
 				while (nt != '\n') nt = fgetc(fp);
 
-				unsigned char* myseq = new unsigned char[maxlen];
-				unsigned char* myseqr = new unsigned char[maxlen];
-				uint32_t _j = 0;
+				std::vector<unsigned char> myseq;
+				myseq.reserve(maxlen);
 				len = 0;
 
 				nt = fgetc(fp);
@@ -1236,7 +1682,7 @@ int build_index(Runopts& opts)
 					{
 						len++;
 						// exact character
-						myseq[_j++] = map_nt[nt];
+						myseq.push_back(map_nt[nt]);
 					}
 					nt = fgetc(fp);
 				}
@@ -1292,124 +1738,7 @@ int build_index(Runopts& opts)
 					numseq_part++;
 				}
 
-				// create a reverse sequence using the forward
-				unsigned char* ptr = &myseq[len - 1];
-				for (_j = 0; _j < len; _j++) {
-					myseqr[_j] = *ptr--;
-				}
-				
-				// 9-mer prefix of 19-mer
-				uint32_t kmer_key_short_f = 0;
-				// 9-mer suffix of 19-mer i.e. prefix of the reversed seq
-				uint32_t kmer_key_short_r = 0;
-				// pointer to next letter to add to 9-mer prefix
-				unsigned char* kmer_key_short_f_p = &myseq[0];
-				// pointer to next letter to add to 9-mer suffix
-				unsigned char* kmer_key_short_r_p = &myseq[partialwin_gv + 1];
-				// pointer to 10-mer of reverse 19-mer to insert
-				// into the mini-burst trie
-				unsigned char* kmer_key_short_r_rp = &myseqr[len - partialwin_gv - 1];
-				// 19-mer
-				unsigned long long int kmer_key = 0;
-				// pointer to 19-mer
-				unsigned char* kmer_key_ptr = &myseq[0];
-
-				// initialize the prefix and suffix 9-mers
-				for (uint32_t j = 0; j < partialwin_gv; j++)
-				{
-					(kmer_key_short_f <<= 2) |= (int)*kmer_key_short_f_p++;
-					(kmer_key_short_r <<= 2) |= (int)*kmer_key_short_r_p++;
-				}
-
-				// initialize the 19-mer
-				for (uint32_t j = 0; j < pread_gv; j++) (kmer_key <<= 2) |= (int)*kmer_key_ptr++;
-
-				uint32_t numwin = (len - pread_gv + opts.interval) / opts.interval; //TESTING
-				uint32_t index_pos = 0;
-
-				// for all 19-mers on the sequence
-				for (uint32_t j = 0; j < numwin; j++) //TESTING
-				{
-					lookup_table[kmer_key_short_f].count++;
-					incremented_by_forward[kmer_key_short_f] = true;
-					// increment 9-mer count only if it wasn't already
-					// incremented by kmer_key_short_f before
-					if (!incremented_by_forward[kmer_key_short_r]) {
-						lookup_table[kmer_key_short_r].count++;
-					}
-
-					// ****** add the forward 19-mer
-
-					// new position for 18-mer in positions_tbl
-					bool new_position = true;
-
-					// forward 19-mer does not exist in the burst trie (duplicates not allowed)
-					if (lookup_table[kmer_key_short_f].trie_F == NULL ||
-						(lookup_table[kmer_key_short_f].trie_F != NULL && 
-						!search_burst_trie(lookup_table[kmer_key_short_f].trie_F, kmer_key_short_f_p, new_position)))
-					{
-						// create a trie node if it doesn't exist
-						if (lookup_table[kmer_key_short_f].trie_F == NULL)
-						{
-							lookup_table[kmer_key_short_f].trie_F = (NodeElement*)malloc(4 * sizeof(NodeElement));
-							if (lookup_table[kmer_key_short_f].trie_F == NULL)
-							{
-								std::cerr << RED << "  ERROR" << COLOFF << ": could not allocate memory for trie_node in indexdb.cpp" << std::endl;
-								exit(EXIT_FAILURE);
-							}
-							memset(lookup_table[kmer_key_short_f].trie_F, 0, 4 * sizeof(NodeElement));
-						}
-
-						insert_prefix(lookup_table[kmer_key_short_f].trie_F, kmer_key_short_f_p);
-					}
-
-					// 18-mer doesn't exist in the burst trie, add it to keys file
-					if (new_position)
-					{
-						// increment number of unique 18-mers
-						number_elements++;
-						keys_vec.push_back(kmer_key >> 2);
-					}
-
-					// ****** add the reverse 19-mer
-					new_position = true;
-
-					// reverse 19-mer does not exist in the burst trie
-					if (lookup_table[kmer_key_short_r].trie_R == NULL ||
-						((lookup_table[kmer_key_short_r].trie_R != NULL) && 
-						!search_burst_trie(lookup_table[kmer_key_short_r].trie_R, kmer_key_short_r_rp, new_position)))
-					{
-						// create a trie node if it doesn't exist
-						if (lookup_table[kmer_key_short_r].trie_R == NULL)
-						{
-							lookup_table[kmer_key_short_r].trie_R = (NodeElement*)malloc(4 * sizeof(NodeElement));
-							if (lookup_table[kmer_key_short_r].trie_R == NULL)
-							{
-								std::cerr << RED << "  ERROR" << COLOFF << ": could not allocate memory for trie_node in indexdb.cpp" << std::endl;
-								exit(EXIT_FAILURE);
-							}
-							memset(lookup_table[kmer_key_short_r].trie_R, 0, 4 * sizeof(NodeElement));
-						}
-
-						insert_prefix(lookup_table[kmer_key_short_r].trie_R, kmer_key_short_r_rp);
-					}
-
-					// shift 19-mer window and both 9-mers
-					if (j != numwin - 1)
-					{
-						for (uint32_t shift = 0; shift < opts.interval; shift++)
-						{
-							((kmer_key_short_f <<= 2) &= mask32) |= (int)*kmer_key_short_f_p++;
-							((kmer_key_short_r <<= 2) &= mask32) |= (int)*kmer_key_short_r_p++;
-							((kmer_key <<= 2) &= mask64) |= (int)*kmer_key_ptr++;
-							kmer_key_short_r_rp--;
-							index_pos++;
-						}
-					}
-				}//~for all 19-mers on the sequence
-
-				delete[] myseq;
-				delete[] myseqr;
+				part_seqs.push_back(std::move(myseq));
 
 			} while (nt != EOF); // end of reads file
 
@@ -1421,8 +1750,34 @@ int build_index(Runopts& opts)
 					"with the current memory limit of ", opts.max_file_size, " Mbytes.\n");
 				break;
 			}
-			// continue to build hash and positions tables
-			else index_size = 0;
+
+			// insert the 19-mers into the burst tries. Each build thread owns the L/2-mers
+			// with 'key % num_threads == thread' and scans all the sequences of the part in order,
+			// so that every mini-burst trie is built exactly as by a single thread
+			uint32_t num_threads = std::max(1U, opts.num_proc_thread);
+			std::vector<std::vector<std::pair<uint64_t, uint64_t>>> thread_keys(num_threads);
+			std::vector<std::thread> threads;
+			for (uint32_t t = 0; t < num_threads; ++t)
+			{
+				threads.emplace_back(insert_kmers, t, num_threads, std::ref(part_seqs), lookup_table,
+					std::ref(incremented_by_forward), std::ref(thread_keys[t]), std::ref(opts));
+			}
+			for (auto& thr : threads) thr.join();
+			threads.clear();
+
+			// unique 18-mers in the order of their first occurrence in the part
+			std::vector<std::pair<uint64_t, uint64_t>> first_keys;
+			for (auto& keys : thread_keys)
+			{
+				first_keys.insert(first_keys.end(), keys.begin(), keys.end());
+				std::vector<std::pair<uint64_t, uint64_t>>().swap(keys);
+			}
+			std::sort(first_keys.begin(), first_keys.end());
+			keys_vec.reserve(first_keys.size());
+			for (auto const& key : first_keys)
+				keys_vec.push_back(key.second);
+			number_elements = static_cast<uint32_t>(keys_vec.size());
+			std::vector<std::pair<uint64_t, uint64_t>>().swap(first_keys);
 
 			elapsed = std::chrono::high_resolution_clock::now() - st;
 
@@ -1444,8 +1799,6 @@ int build_index(Runopts& opts)
 				assert(dup == sorted_keys.end() && "Duplicate keys in keys_vec - BBHash will be incorrect");
 			}
 
-			using hasher_t = boomphf::SingleHashFunctor<uint64_t>;
-			using boophf_t = boomphf::mphf<uint64_t, hasher_t>;
 			boophf_t* hash = new boophf_t(keys_vec.size(), keys_vec, 1, 2.0, false, false);
 
 			// Bug 3 check: all IDs must be in [0, number_elements) AND be unique
@@ -1486,136 +1839,18 @@ int build_index(Runopts& opts)
 
 			memset(positions_tbl, 0, number_elements * sizeof(kmer_origin));
 
-			// sequence number
-			uint32_t i = 0;
-
-			// reset the file pointer to the beginning of the current part
-			fseek(fp, start_part, SEEK_SET);
-
 			st = std::chrono::high_resolution_clock::now();
-			do
+			for (uint32_t t = 0; t < num_threads; ++t)
 			{
-				long int start_seq = ftell(fp);
-				nt = fgetc(fp);
-
-				// scan to end of header name
-				while (nt != '\n')
-				{
-					nt = fgetc(fp);
-				}
-
-				unsigned char* myseq = new unsigned char[maxlen];
-				unsigned char* myseqr = new unsigned char[maxlen];
-				uint32_t _j = 0;
-				len = 0;
-
-				// encode each sequence using integer alphabet {0,1,2,3}
-				nt = fgetc(fp);
-				while (nt != '>' && nt != EOF)
-				{
-					// skip line feed, carriage return or empty space in the sequence
-					if (nt != '\n' && nt != ' ')
-					{
-						len++;
-						myseq[_j++] = map_nt[nt]; // exact character
-					}
-					nt = fgetc(fp);
-				}
-
-				if (nt != EOF) ungetc(nt, fp); // put back the '>'
-
-				// check the addition of this sequence will not overflow the maximum memory
-				double estimated_seq_mem = (len - pread_gv + 1)*9.5e-6;
-
-				// the sequence alone is too large, it will not fit into maximum memory, skip it
-				if (estimated_seq_mem > opts.max_file_size) continue;
-				// the additional sequence will overflow the maximum index memory,
-				// write existing index to disk and start a new index
-				else if (index_size + estimated_seq_mem > opts.max_file_size)
-				{
-					// set the character to something other than EOF
-					if (nt == EOF) nt = 'A';
-
-					// scan back to start of sequence for next index part
-					fseek(fp, start_seq, SEEK_SET);
-					break;
-				}
-				// add the additional sequence to the index
-				else
-				{
-					index_size += estimated_seq_mem;
-				}
-
-				// create a reverse sequence using the forward
-				unsigned char* ptr = &myseq[len - 1];
-
-				for (_j = 0; _j < len; _j++) myseqr[_j] = *ptr--;
-
-				uint32_t kmer_key_short_f = 0;
-				uint32_t kmer_key_short_r = 0;
-				unsigned char* kmer_key_short_f_p = &myseq[0];
-				unsigned char* kmer_key_short_r_p = &myseq[partialwin_gv + 1];
-				unsigned char* kmer_key_short_r_rp = &myseqr[len - partialwin_gv - 1];
-				unsigned long long int kmer_key = 0;
-				unsigned char* kmer_key_ptr = &myseq[0];
-
-				// initialize the 9-mers
-				for (uint32_t j = 0; j < partialwin_gv; j++)
-				{
-					(kmer_key_short_f <<= 2) |= (int)*kmer_key_short_f_p++;
-					(kmer_key_short_r <<= 2) |= (int)*kmer_key_short_r_p++;
-				}
-
-				// initialize the 19-mer
-				for (uint32_t j = 0; j < pread_gv; j++)
-					(kmer_key <<= 2) |= (int)*kmer_key_ptr++;
-
-				uint32_t numwin = (len - pread_gv + opts.interval) / opts.interval; //TESTING
-				uint32_t id = 0;
-
-				uint32_t index_pos = 0; //TESTING
-
-				// for all 19-mers on the sequence
-				for (uint32_t j = 0; j < numwin; j++) //TESTING
-				{
-					// Bug 1 check: BBHash silently returns a false-positive for absent keys
-					uint64_t raw_id = hash->lookup(kmer_key >> 2);
-					assert(raw_id < number_elements && "BBHash lookup returned out-of-range id - key not in MPHF");
-					id = static_cast<uint32_t>(raw_id);
-
-					//cout << "\t" << id << "=" << (kmer_key>>2); //TESTING
-
-					add_id_to_burst_trie(lookup_table[kmer_key_short_f].trie_F, kmer_key_short_f_p, id);
-					add_id_to_burst_trie(lookup_table[kmer_key_short_r].trie_R, kmer_key_short_r_rp, id);
-
-					add_kmer_to_table(positions_tbl + id, i, index_pos, opts.max_pos);
-
-					// shift the 19-mer and 9-mers
-					if (j != numwin - 1)
-					{
-						for (uint32_t shift = 0; shift < opts.interval; shift++)
-						{
-							((kmer_key_short_f <<= 2) &= mask32) |= (int)*kmer_key_short_f_p++;
-							((kmer_key_short_r <<= 2) &= mask32) |= (int)*kmer_key_short_r_p++;
-							((kmer_key <<= 2) &= mask64) |= (int)*kmer_key_ptr++;
-							kmer_key_short_r_rp--;
-							index_pos++;
-						}
-					}
-				} 
-
-				delete[] myseq;
-				delete[] myseqr;
-
-				// next sequence
-				i++;
-
-			} while (nt != EOF); // for all file     
+				threads.emplace_back(add_ids_and_positions, t, num_threads, std::ref(part_seqs), lookup_table,
+					hash, positions_tbl, number_elements, std::ref(opts));
+			}
+			for (auto& thr : threads) thr.join();
 
 			if (opts.is_verbose) {
 				elapsed = std::chrono::high_resolution_clock::now() - st;
 				INFO_NS(" done [", elapsed.count(), " sec]\n");
-				INFO_NS("    total number of sequences in this part = ", i, "\n");
+				INFO_NS("    total number of sequences in this part = ", part_seqs.size(), "\n");
 			}
 
 			delete hash;
@@ -1803,20 +2038,8 @@ int build_index(Runopts& opts)
 			ss << part_num;
 			std::string part_str = ss.str();
 
-			// 1. load the kmer 'count' variable /index/kmer.dat
-			std::string idx_file = idxpair.second + ".kmer_" + part_str + ".dat";
-			std::ofstream oskmer(idx_file, std::ios::binary);
-			if (!oskmer.is_open())
-			{
-				ERR("Failed to open file: ", idx_file, " for writing. Error: ", strerror(errno));
-				exit(1);
-			}
-
-			if (opts.is_verbose) {
-				INFO_NS("      writing kmer data to ", idx_file.data(), "\n")
-			}
-
 			index_parts_stats thispart;
+			std::memset(&thispart, 0, sizeof(index_parts_stats)); // zero the padding, the struct is written to file as is
 			thispart.start_part = start_part;
 			thispart.seq_part_size = seq_part_size;
 			thispart.numseq_part = numseq_part;
@@ -1828,54 +2051,36 @@ int build_index(Runopts& opts)
 			for (uint32_t j = 0; j < (uint32_t)(1 << opts.seed_win_len); j++)
 			{
 				uint32_t cnt = lookup_table[j].count;
-				oskmer.write(reinterpret_cast<const char*>(&cnt), sizeof(uint32_t));
 				if (cnt > 0) ++kmer_nonzero;
 				kmer_total += cnt;
 				if (cnt > kmer_max) kmer_max = cnt;
 			}
-			oskmer.close();
-			uint64_t kmer_file_bytes = std::filesystem::file_size(idx_file);
-
-			// 2. mini-burst tries
-			// load 9-mer look-up table and mini-burst tries to /index/bursttrief.dat
-			idx_file = idxpair.second + ".bursttrie_" + part_str + ".dat";
-			if (opts.is_verbose) {
-				INFO_NS("      writing burst tries to ", idx_file, "\n");
-			}
 
-			load_index(lookup_table, (char*)idx_file.data(), opts);
-			uint64_t bursttrie_file_bytes = std::filesystem::file_size(idx_file);
-
-			// 3. 19-mer position look up tables
-			idx_file = idxpair.second + ".pos_" + part_str + ".dat";
-			std::ofstream ospos(idx_file, std::ios::binary);
-
-			if (opts.is_verbose) {
-				INFO_NS("      writing position lookup table to ", idx_file.data(), "\n");
-			}
-
-			// number of unique 19-mers
-			ospos.write(reinterpret_cast<const char*>(&number_elements), sizeof(uint32_t));
-			// the positions
+			// the 19-mer positions
 			uint64_t pos_total = 0;
 			uint32_t pos_max = 0;
 			for (uint32_t j = 0; j < number_elements; j++)
 			{
 				uint32_t size = positions_tbl[j].size;
-				ospos.write(reinterpret_cast<const char*>(&size), sizeof(uint32_t));
-				ospos.write(reinterpret_cast<const char*>(positions_tbl[j].arr), sizeof(seq_pos)*size);
 				pos_total += size;
 				if (size > pos_max) pos_max = size;
 			}
-			ospos.close();
-			uint64_t pos_file_bytes = std::filesystem::file_size(idx_file);
+
+			// 9-mer look-up table, 19-mer positions and mini-burst tries to /index/idx_N.dat
+			std::string idx_file = idxpair.second + ".idx_" + part_str + ".dat";
+			if (opts.is_verbose) {
+				INFO_NS("      writing index to ", idx_file, "\n");
+			}
+
+			uint64_t pos_bytes = 0;
+			uint64_t idx_file_bytes = write_index_part(idx_file, lookup_table, positions_tbl, number_elements, pos_bytes, opts);
 
 			// stash per-part stats for YAML output
 			yaml_parts.push_back({
 				numseq_part, seq_part_size,
 				kmer_nonzero, kmer_total, kmer_max,
-				number_elements, pos_total, pos_max,
-				kmer_file_bytes, bursttrie_file_bytes, pos_file_bytes
+				number_elements, pos_total, pos_max, pos_bytes,
+				idx_file_bytes
 			});
 
 			// Free malloc'd memory
@@ -1995,9 +2200,7 @@ int build_index(Runopts& opts)
 					yaml_out << "    numseq_part: "    << yp.numseq_part       << "\n";
 					yaml_out << "    seq_part_size: "  << yp.seq_part_size     << "\n";
 					yaml_out << "    files:\n";
-					yaml_out << "      bursttrie_"     << pi << ".dat: " << yp.bursttrie_file_bytes << "\n";
-					yaml_out << "      pos_"           << pi << ".dat: " << yp.pos_file_bytes       << "\n";
-					yaml_out << "      kmer_"          << pi << ".dat: " << yp.kmer_file_bytes      << "\n";
+					yaml_out << "      idx_"           << pi << ".dat: " << yp.idx_file_bytes       << "\n";
 					yaml_out << "    kmer:\n";
 					yaml_out << "      num_nonzero: "  << yp.kmer_num_nonzero  << "\n";
 					yaml_out << "      total_count: "  << yp.kmer_total_count  << "\n";
@@ -2006,6 +2209,8 @@ int build_index(Runopts& opts)
 					yaml_out << "      num_elements: "   << yp.pos_num_elements   << "\n";
 					yaml_out << "      total_positions: " << yp.pos_total_positions << "\n";
 					yaml_out << "      max_positions: "  << yp.pos_max_positions  << "\n";
+					yaml_out << "      bytes: "          << yp.pos_bytes          << "\n";
+					yaml_out << "      bytes_fixed: "    << yp.pos_total_positions * sizeof(seq_pos) << "\n";
 				}
 				yaml_out.close();
 				if (opts.is_verbose)
@@ -2016,6 +2221,13 @@ int build_index(Runopts& opts)
 				WARN("Could not create index stats file: ", yaml_path);
 			}
 
+			// the descriptor goes last - it marks the index as complete
+			std::ofstream desc_out(idxpair.second + INDEX_DESC_SFX, std::ios::binary);
+			desc_out << descriptor;
+			desc_out.close();
+			if (!desc_out.good())
+				WARN("Could not write index descriptor: ", idxpair.second + INDEX_DESC_SFX, ". The index will be re-built on the next run.");
+
 			INFO_NS("  done.\n\n");
 		}
 
@@ -36,18 +36,208 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "kvdb.hpp"
 #include "common.hpp"
+#include "options.hpp"
 
+#include <cassert>
 #include <iostream>
 #include <filesystem>
+#include <fstream>
+#include <functional> // std::hash
+#include <mutex>
+#include <unordered_map>
 
-KeyValueDatabase::KeyValueDatabase(std::string const &kvdbPath) 
+#include "rocksdb/db.h"
+#include "rocksdb/slice.h"
+#include "rocksdb/options.h"
+#include "rocksdb/write_batch.h"
+#include "rocksdb/iterator.h"
+
+#define KVDB_MEM_SHARDS 64 // independently locked parts of the in-memory store
+#define KVDB_CURSOR_STEPS 16 // max records a cursor steps over before it seeks the key
+#define KVDB_READAHEAD (2 << 20) // readahead of the cursor iterator
+
+namespace {
+
+class RocksdbStore : public KvStore {
+public:
+	RocksdbStore(std::string const& kvdbPath, bool is_wal)
+	{
+		// init and open key-value database for read matches
+		options.IncreaseParallelism();
+		options.compression = rocksdb::kZlibCompression;
+		options.create_if_missing = true;
+		write_options.disableWAL = !is_wal;
+		rocksdb::Status s = rocksdb::DB::Open(options, kvdbPath, &kvdb);
+		assert(s.ok());
+	}
+	~RocksdbStore() { delete kvdb; }
+
+	void put(const std::string& key, const std::string& val) override
+	{
+		rocksdb::Status s = kvdb->Put(write_options, key, val);
+	}
+
+	void write(std::vector<std::pair<std::string, std::string>>& records) override
+	{
+		rocksdb::WriteBatch batch;
+		for (auto const& rec : records)
+			batch.Put(rec.first, rec.second);
+		rocksdb::Status s = kvdb->Write(write_options, &batch);
+		if (!s.ok()) {
+			ERR("failed writing ", records.size(), " records to the key-value DB: ", s.ToString());
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	std::string get(const std::string& key) override
+	{
+		std::string val;
+		rocksdb::Status s = kvdb->Get(rocksdb::ReadOptions(), key, &val);
+		return val;
+	}
+
+	bool view(const std::string& key, const std::function<void(std::string_view)>& fn) override
+	{
+		rocksdb::PinnableSlice val; // pins the block of the value in the block cache or the memtable
+		rocksdb::Status s = kvdb->Get(rocksdb::ReadOptions(), kvdb->DefaultColumnFamily(), key, &val);
+		if (!s.ok())
+			return false;
+		fn(std::string_view(val.data(), val.size()));
+		return true;
+	}
+
+	/* forward iterator over a snapshot of the DB */
+	class IterCursor : public Cursor {
+	public:
+		IterCursor(rocksdb::DB* kvdb)
+		{
+			rocksdb::ReadOptions ropts;
+			ropts.readahead_size = KVDB_READAHEAD;
+			ropts.fill_cache = false; // each record is read once
+			iter.reset(kvdb->NewIterator(ropts));
+		}
+
+		bool view(const std::string& key, const std::function<void(std::string_view)>& fn) override
+		{
+			rocksdb::Slice target(key);
+			if (is_seek || last.compare(key) > 0)
+			{
+				iter->Seek(target);
+				is_seek = false;
+			}
+			else
+			{
+				int steps = 0;
+				for (; iter->Valid() && iter->key().compare(target) < 0 && steps < KVDB_CURSOR_STEPS; ++steps)
+					iter->Next();
+				if (steps == KVDB_CURSOR_STEPS)
+					iter->Seek(target);
+			}
+			last = key;
+			if (!iter->Valid() || iter->key().compare(target) != 0)
+				return false;
+			rocksdb::Slice val = iter->value();
+			fn(std::string_view(val.data(), val.size()));
+			return true;
+		}
+	private:
+		std::unique_ptr<rocksdb::Iterator> iter;
+		std::string last; // previous key
+		bool is_seek = true;
+	};
+
+	std::unique_ptr<Cursor> cursor() override { return std::unique_ptr<Cursor>(new IterCursor(kvdb)); }
+private:
+	rocksdb::DB* kvdb;
+	rocksdb::Options options;
+	rocksdb::WriteOptions write_options;
+};
+
+/* sharded hash map. No compression, no background flushes or compactions */
+class MemStore : public KvStore {
+public:
+	MemStore() : shards(KVDB_MEM_SHARDS) {}
+
+	void put(const std::string& key, const std::string& val) override
+	{
+		auto& sh = shard(key);
+		std::lock_guard<std::mutex> lock(sh.lock);
+		sh.map[key] = val;
+	}
+
+	void write(std::vector<std::pair<std::string, std::string>>& records) override
+	{
+		for (auto& rec : records)
+		{
+			auto& sh = shard(rec.first);
+			std::lock_guard<std::mutex> lock(sh.lock);
+			sh.map[std::move(rec.first)] = std::move(rec.second);
+		}
+	}
+
+	std::string get(const std::string& key) override
+	{
+		auto& sh = shard(key);
+		std::lock_guard<std::mutex> lock(sh.lock);
+		auto it = sh.map.find(key);
+		return it == sh.map.end() ? std::string() : it->second;
+	}
+
+	bool view(const std::string& key, const std::function<void(std::string_view)>& fn) override
+	{
+		auto& sh = shard(key);
+		std::lock_guard<std::mutex> lock(sh.lock);
+		auto it = sh.map.find(key);
+		if (it == sh.map.end())
+			return false;
+		fn(it->second);
+		return true;
+	}
+
+	/* no order of the keys in the hash map, the lookups are in memory anyway */
+	class MapCursor : public Cursor {
+	public:
+		MapCursor(MemStore& store) : store(store) {}
+		bool view(const std::string& key, const std::function<void(std::string_view)>& fn) override { return store.view(key, fn); }
+	private:
+		MemStore& store;
+	};
+
+	std::unique_ptr<Cursor> cursor() override { return std::unique_ptr<Cursor>(new MapCursor(*this)); }
+private:
+	struct Shard
+	{
+		std::mutex lock;
+		std::unordered_map<std::string, std::string> map;
+	};
+	Shard& shard(const std::string& key) { return shards[std::hash<std::string>()(key) % shards.size()]; }
+
+	std::vector<Shard> shards;
+};
+
+/* 'MemAvailable' of /proc/meminfo in bytes, 0 if not known */
+uint64_t mem_available()
+{
+	std::ifstream meminfo("/proc/meminfo");
+	std::string name;
+	uint64_t kb = 0;
+	std::string unit;
+	while (meminfo >> name >> kb >> unit)
+	{
+		if (name == "MemAvailable:")
+			return kb << 10;
+	}
+	return 0;
+}
+
+} // ~namespace
+
+KeyValueDatabase::KeyValueDatabase(std::string const &kvdbPath, KvdbType type, bool is_wal)
 {
-	// init and open key-value database for read matches
-	options.IncreaseParallelism();
-	options.compression = rocksdb::kZlibCompression;
-	options.create_if_missing = true;
-	rocksdb::Status s = rocksdb::DB::Open(options, kvdbPath, &kvdb);
-	assert(s.ok());
+	if (type == KvdbType::memory)
+		store.reset(new MemStore());
+	else
+		store.reset(new RocksdbStore(kvdbPath, is_wal));
 }
 
 /* 
@@ -58,14 +248,53 @@ int KeyValueDatabase::clear(std::string dbpath)
 	return 0;
 } // ~KeyValueDatabase::clear
 
-void KeyValueDatabase::put(std::string key, std::string val)
+KvdbType kvdb_type(uint64_t num_reads, Runopts& opts)
 {
-	rocksdb::Status s = kvdb->Put(rocksdb::WriteOptions(), key, val);
+	if (opts.is_kvdb_disk)
+	{
+		INFO("Key-value DB: RocksDB as '", OPT_KVDB_DISK, "' was specified");
+		return KvdbType::rocksdb;
+	}
+	if (opts.task != Runopts::TASK::all)
+	{
+		INFO("Key-value DB: RocksDB. The results are kept for the other tasks ('", OPT_TASK, "' is not 4)");
+		return KvdbType::rocksdb;
+	}
+
+	if (opts.num_alignments == 0)
+	{
+		INFO("Key-value DB: RocksDB. All the alignments of the reads are stored, the size of the results is not known");
+		return KvdbType::rocksdb;
+	}
+
+	// upper estimate: all the reads aligned with the max number of alignments
+	uint64_t num_align = opts.num_alignments;
+	uint64_t need = num_reads * (KVDB_MEM_READ_BYTES + num_align * KVDB_MEM_ALIGN_BYTES);
+	uint64_t avail = mem_available();
+	if (avail == 0 || need > avail / 2)
+	{
+		INFO("Key-value DB: RocksDB. The results of ", num_reads, " reads need about ", need >> 20,
+			" MB, available memory ", avail >> 20, " MB");
+		return KvdbType::rocksdb;
+	}
+	INFO("Key-value DB: in memory. The results of ", num_reads, " reads need about ", need >> 20,
+		" MB, available memory ", avail >> 20, " MB");
+	return KvdbType::memory;
+} // ~kvdb_type
+
+void KvdbBatch::put(const std::string& key, const std::string& val)
+{
+	records.emplace_back(key, val);
+	bytes += key.size() + val.size();
+	if (records.size() >= KVDB_BATCH_COUNT || bytes >= KVDB_BATCH_BYTES)
+		flush();
 }
 
-std::string KeyValueDatabase::get(std::string key)
+void KvdbBatch::flush()
 {
-	std::string val;
-	rocksdb::Status s = kvdb->Get(rocksdb::ReadOptions(), key, &val);
-	return val;
-}
\ No newline at end of file
+	if (records.empty())
+		return;
+	kvdb.write(records);
+	records.clear();
+	bytes = 0;
+}
@@ -76,8 +76,8 @@ int main(int argc, char** argv)
 		}
 
 		// init common objects
-		KeyValueDatabase kvdb(opts.kvdbdir.string());
 		Readfeed readfeed(opts.feed_type, opts.readfiles, opts.num_proc_thread, opts.readb_dir, opts.is_paired);
+		KeyValueDatabase kvdb(opts.kvdbdir.string(), kvdb_type(readfeed.num_reads_tot, opts), !opts.is_no_wal);
 		Readstats readstats(readfeed.num_reads_tot, readfeed.length_all, readfeed.min_read_len, readfeed.max_read_len, kvdb, opts);
 
 		switch (opts.task)
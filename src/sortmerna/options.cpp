@@ -1215,6 +1215,78 @@ void Runopts::opt_score_split(const std::string& val)
 	is_score_split = true;
 }
 
+void Runopts::opt_reads_major(const std::string& val)
+{
+	is_reads_major = true;
+}
+
+void Runopts::opt_dedup(const std::string& val)
+{
+	is_dedup = true;
+}
+
+void Runopts::opt_no_wal(const std::string& val)
+{
+	is_no_wal = true;
+}
+
+void Runopts::opt_kvdb_disk(const std::string& val)
+{
+	is_kvdb_disk = true;
+}
+
+void Runopts::opt_read_cache(const std::string& val)
+{
+	if (val.size() == 0)
+	{
+		ERR("'", OPT_READ_CACHE, "' [INT] requires a positive integer as input (ex. --", OPT_READ_CACHE, " 100000)");
+		exit(EXIT_FAILURE);
+	}
+
+	char* end = 0;
+	long num = strtol(val.data(), &end, 10);
+	if (num < 0 || num > UINT32_MAX || *end != '\0')
+	{
+		ERR("'", OPT_READ_CACHE, "' [INT] requires a non-negative integer as input (ex. --", OPT_READ_CACHE, " 100000)");
+		exit(EXIT_FAILURE);
+	}
+	read_cache = static_cast<uint32_t>(num);
+}
+
+void Runopts::opt_band(const std::string& val)
+{
+	if (val.size() == 0)
+	{
+		ERR("'", OPT_BAND, "' [INT] requires a positive integer as input (ex. --", OPT_BAND, " 10)");
+		exit(EXIT_FAILURE);
+	}
+
+	char* end = 0;
+	band = (int)strtol(val.data(), &end, 10);
+	if (band < 0 || *end != '\0')
+	{
+		ERR("'", OPT_BAND, "' [INT] requires a non-negative integer as input (ex. --", OPT_BAND, " 10)");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void Runopts::opt_xdrop_lossy(const std::string& val)
+{
+	if (val.size() == 0)
+	{
+		ERR("'", OPT_XDROP_LOSSY, "' [INT] requires a positive integer as input (ex. --", OPT_XDROP_LOSSY, " 20)");
+		exit(EXIT_FAILURE);
+	}
+
+	char* end = 0;
+	xdrop_lossy = (int)strtol(val.data(), &end, 10);
+	if (xdrop_lossy < 0 || *end != '\0')
+	{
+		ERR("'", OPT_XDROP_LOSSY, "' [INT] requires a non-negative integer as input (ex. --", OPT_XDROP_LOSSY, " 20)");
+		exit(EXIT_FAILURE);
+	}
+}
+
 /* 
  * called from validate
  */
@@ -128,7 +128,7 @@ size_t OtuMap::count_otu()
 /*
   runs in a thread
 */
-void fill_otu_map2(int id, OtuMap& otumap, Readfeed& readfeed, References& refs, KeyValueDatabase& kvdb, Runopts& opts)
+void fill_otu_map2(int id, OtuMap& otumap, Readfeed& readfeed, References& refs, Readstats& readstats, KeyValueDatabase& kvdb, Runopts& opts)
 {
 	unsigned c_reads = 0;  // all reads count
 	unsigned c_aligned = 0; // aligned reads
@@ -137,6 +137,7 @@ void fill_otu_map2(int id, OtuMap& otumap, Readfeed& readfeed, References& refs,
 	//unsigned c_nid_ycov = 0;
 	//unsigned c_nid_ncov = 0;
 	std::string readstr;
+	KvdbCursor cursor(kvdb); // the reads of a thread come in the order of the keys
 
 	if (opts.dbg_level == 2)
 		INFO("OTU map thread ", id, " : ", std::this_thread::get_id(), " started");
@@ -146,7 +147,8 @@ void fill_otu_map2(int id, OtuMap& otumap, Readfeed& readfeed, References& refs,
 		{
 			Read read(readstr);
 			read.init(opts);
-			read.load_db(kvdb);
+			if (readstats.is_stored(read.readfile_idx, read.read_num))
+				read.load_db(cursor);
 
 			if (!read.isValid)
 				continue;
@@ -241,7 +243,7 @@ void fill_otu_map(Readfeed& readfeed,
 				//	 opts.feed_type == FEED_TYPE::INDEXED_FLAT) {
 				for (int i = 0; i < numThreads; ++i) {
 					tpool.emplace_back(std::thread(fill_otu_map2, i, std::ref(otumap),
-						std::ref(readfeed), std::ref(refs),	std::ref(kvdb), std::ref(opts)));
+						std::ref(readfeed), std::ref(refs), std::ref(readstats), std::ref(kvdb), std::ref(opts)));
 				}
 				//}
 
@@ -81,6 +81,7 @@ void report(const uint32_t& id,
 	Readfeed& readfeed,
 	References& refs,
 	Refstats& refstats,
+	Readstats& readstats,
 	KeyValueDatabase& kvdb,
 	Output& output,
 	Runopts& opts)
@@ -91,6 +92,7 @@ void report(const uint32_t& id,
 	uint16_t num_reads = opts.is_paired ? 2 : 1; // i.e. max 2
 	std::string readstr;
 	std::vector<Read> reads; // two reads if paired, a single read otherwise
+	KvdbCursor cursors[2] = { kvdb, kvdb }; // the reads of a thread come in the order of the keys, per reads file
 
 	INFO_MEM("Report Processor: ", id, " thread: ", std::this_thread::get_id(), " started.");
 	//auto start = std::chrono::high_resolution_clock::now();
@@ -105,7 +107,8 @@ void report(const uint32_t& id,
 			{
 				reads.emplace_back(Read(readstr));
 				reads[i].init(opts);
-				reads[i].load_db(kvdb);
+				if (readstats.is_stored(reads[i].readfile_idx, reads[i].read_num))
+					reads[i].load_db(cursors[i]);
 				readstr.resize(0);
 				++countReads;
 			}
@@ -210,7 +213,7 @@ void writeReports(Readfeed& readfeed, Readstats& readstats, KeyValueDatabase& kv
 			//if (opts.feed_type == FEED_TYPE::SPLIT_READS || opts.feed_type == FEED_TYPE::INDEXED_GZ || opts.feed_type == FEED_TYPE::INDEXED_FLAT) {
 			for (uint32_t i = 0; i < nthreads; ++i) {
 				tpool.emplace_back(std::thread(report, i, std::ref(readfeed),
-					std::ref(refs), std::ref(refstats), std::ref(kvdb), std::ref(output), std::ref(opts)));
+					std::ref(refs), std::ref(refstats), std::ref(readstats), std::ref(kvdb), std::ref(output), std::ref(opts)));
 			}
 			//}
 			// wait till processing is done
@@ -57,6 +57,7 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include "readfeed.hpp"
 #include "output.hpp"
 #include "readsqueue.hpp"
+#include "workspace.hpp"
 
 
 #define O_SMR_READ_BIN O_RDONLY
@@ -73,6 +74,7 @@ int clear_dir(std::string dpath);
  * Called on each index * index_part * read.num_strands
  *
  * @param isLastStrand flags when the last strand (out of max 2 strands) is passed for matching
+ * @param ws  scratch buffers of the calling Processor thread
  */
 void traverse
 	(
@@ -82,7 +84,8 @@ void traverse
 		Readstats& readstats, 
 		Refstats& refstats, 
 		Read& read,
-		bool isLastStrand
+		bool isLastStrand,
+		Workspace& ws
 	)
 {
 	read.lastIndex = index.index_num;
@@ -91,13 +94,12 @@ void traverse
 	uint32_t win_shift = opts.skiplengths[index.index_num][0];
 	// keep track of windows (read positions) which have already been traversed
 	// in the burst trie using different shifts. Initially all False
-	vector<bool> read_pos_searched(read.sequence.size());
+	auto& read_pos_searched = ws.read_pos_searched;
+	read_pos_searched.assign(read.sequence.size(), false);
 
 	size_t pass_n = 0; // Pass number (possible value 0,1,2)
 	uint32_t max_SW_score = read.sequence.size() * opts.match; // the maximum SW score attainable for this read
 
-	std::vector<UCHAR> bitvec; // window (prefix/suffix) bitvector
-
 	// TODO: below 2 values are unique per index part. Move to index?
 	//   e.g. 9 - 2 = 0000 0111 << 2 = 0001 1100 = 28
 	uint32_t bitvec_size = (refstats.partialwin[index.index_num] - 2) << 2;
@@ -105,6 +107,15 @@ void traverse
 	//   e.g. 9 - 3 = 0000 0110 << 2 = 0001 1000 = 24
 	uint32_t offset = (refstats.partialwin[index.index_num] - 3) << 2;
 
+	// the windows are searched in batches of interleaved trie traversals, one traversal per window
+	if (ws.bitvec.size() < TRAVERSAL_BATCH * bitvec_size)
+		ws.bitvec.resize(TRAVERSAL_BATCH * bitvec_size); // window (prefix/suffix) bitvectors
+	auto& bitvec = ws.bitvec;
+	auto& trav = ws.trav;
+	auto& batch_pos = ws.batch_pos; // positions of the windows to search in the current Pass
+	auto& kmer_hash = ws.kmer_hash; // hashes of the half windows on this strand
+	bool is_hashed = false;
+
 	// loop search positions on the read in multiple passes
 	// changing the step (skip length/windowshift) when necessary
 	for (bool search = true; search; )
@@ -115,34 +126,56 @@ void traverse
 				read.sequence.size() - refstats.lnwin[index.index_num] + win_shift
 			) / win_shift;
 
-		uint32_t win_pos = 0; // position (index) of the window's first char on the read i.e. [0...read.sequence.length-1]
-		// iterate the windows
-		for (uint32_t win_num = 0; win_num < numwin; ++win_num)
-		{
-			if (read.is04) read.flip34(); // Make sure the read is in 03 encoding for index search
+		// Make sure the read is in 03 encoding for index search
+		// The flip changes the ambiguous positions => hash the half windows again
+		if (read.is04) {
+			read.flip34();
+			is_hashed = false;
+		}
+		if (!is_hashed) {
+			read.hashKmers(refstats.partialwin[index.index_num], kmer_hash);
+			is_hashed = true;
+		}
 
-			// skip position when the seed at this position has already been searched for in a previous Passes
+		// skip positions when the seed at the position has already been searched for in a previous Pass
+		batch_pos.clear();
+		for (uint32_t win_num = 0, win_pos = 0; win_num < numwin; ++win_num, win_pos += win_shift)
+		{
 			if (!read_pos_searched[win_pos])
 			{
 				read_pos_searched[win_pos] = true; // mark position as searched
-				// this flag it set to true if a match is found during
-				// subsearch 1(a), to skip subsearch 1(b)
-				bool accept_zero_kmer = false;
-				// ids for k-mers hits on the reference database
-				vector<id_win> id_hits; // TODO: add directly to 'id_win_hits'? - No, id_win_hits may contain hits from different index parts.
-
-				bitvec.resize(bitvec_size);
-				std::fill(bitvec.begin(), bitvec.end(), 0);
+				batch_pos.push_back(win_pos);
+			}
+		}
 
-				auto ii = win_pos + refstats.partialwin[index.index_num];
-				init_win_f(&read.isequence[ii],	&bitvec[0],	&bitvec[4],	refstats.numbvs[index.index_num]);
+		for (std::size_t first = 0; first < batch_pos.size(); first += TRAVERSAL_BATCH)
+		{
+			std::size_t num_trav = std::min<std::size_t>(TRAVERSAL_BATCH, batch_pos.size() - first);
+
+			// subsearch (1)(a) d([p_1],[w_1]) = 0 and d([p_2],[w_2]) <= 1;
+			//
+			//  w = |------ [w_1] ------|------ [w_2] ------|
+			//  p = |------ [p_1] ------|------ [p_2] ----| (0/1 deletion in [p_2])
+			//              or
+			//    = |------ [p_1] ------|------ [p_2] ------| (0/1 match/substitution in [p_2])
+			//        or
+			//    = |------ [p_1] ------|------ [p_2] --------| (0/1 insertion in [p_2])
+			//
+			for (std::size_t i = 0; i < num_trav; ++i)
+			{
+				uint32_t win_pos = batch_pos[first + i];
+				// ids for k-mers hits on the reference database
+				trav[i].id_hits.clear(); // id_hits may not go directly to 'id_win_hits' - it may contain hits from different index parts.
+				// set to true if a match is found during subsearch 1(a), to skip subsearch 1(b)
+				trav[i].accept_zero_kmer = false;
+				trav[i].is_done = true;
 
 				// the hash of the 'first half' of the kmer window
-				uint32_t keyf = read.hashKmer(win_pos, refstats.partialwin[index.index_num]);
+				uint32_t keyf = kmer_hash[win_pos];
 
 				// TODO: remove in production
-				if (index.lookup_tbl.size() <= keyf) {
-					size_t vsize = index.lookup_tbl.size();
+				if (index.lookup_tbl_size <= keyf) {
+					size_t vsize = index.lookup_tbl_size;
 					uint16_t idxn = index.index_num;
 					uint16_t idxp = index.part;
 					std::string id = read.id;
@@ -153,129 +186,123 @@ void traverse
 					exit(EXIT_FAILURE);
 				}
 
+				// the exact L-mers probed below. The look-up entries of the batch are read in parallel
+				__builtin_prefetch(index.exact_tbl + index.lookup_tbl[keyf].exact);
+			}
+
+			for (std::size_t i = 0; i < num_trav; ++i)
+			{
+				uint32_t win_pos = batch_pos[first + i];
+				UCHAR* bv = &bitvec[i * bitvec_size];
+				uint32_t keyf = kmer_hash[win_pos];
+
 				// do traversal if the exact half window exists in the burst trie
-				if ( index.lookup_tbl[keyf].count > opts.minoccur && index.lookup_tbl[keyf].trie_F != NULL )
+				if ( index.lookup_tbl[keyf].count > opts.minoccur && index.lookup_tbl[keyf].trie_F != 0 )
 				{
-					/* subsearch (1)(a) d([p_1],[w_1]) = 0 and d([p_2],[w_2]) <= 1;
-					*
-					*  w = |------ [w_1] ------|------ [w_2] ------|
-					*  p = |------ [p_1] ------|------ [p_2] ----| (0/1 deletion in [p_2])
-					*              or
-					*    = |------ [p_1] ------|------ [p_2] ------| (0/1 match/substitution in [p_2])
-					*        or
-					*    = |------ [p_1] ------|------ [p_2] --------| (0/1 insertion in [p_2])
-					*
-					*/
-					traversetrie_align(
-						index.lookup_tbl[keyf].trie_F,
-						0,
-						0,
-						&bitvec[0],
-						&bitvec[offset],
-						accept_zero_kmer,
-						id_hits,
-						win_pos,
-						refstats.partialwin[index.index_num],
-						opts
-					);
-				} //~if exact half window exists in the burst trie
+					// the whole window is in the index: the traversal would stop at its exact match
+					// with this single hit and skip subsearch (1)(b), see 'TrieTraversal::scan_bucket'
+					uint32_t id = 0;
+					if (!opts.is_full_search && index.find_exact(keyf, kmer_hash[win_pos + refstats.partialwin[index.index_num]], id))
+					{
+						trav[i].id_hits.emplace_back(id, win_pos);
+						trav[i].accept_zero_kmer = true;
+						continue;
+					}
 
+					std::fill(bv, bv + bitvec_size, 0);
+					auto ii = win_pos + refstats.partialwin[index.index_num];
+					init_win_f(&read.isequence[ii],	bv,	bv + 4,	refstats.numbvs[index.index_num]);
+					trav[i].start(index.trie_F(keyf), bv, bv + offset, win_pos, refstats.partialwin[index.index_num]);
+				}
+			}
+			traversetrie_align_batch(trav.data(), num_trav, opts);
+
+			// subsearch (1)(b) d([p_1],[w_1]) = 1 and d([p_2],[w_2]) = 0;
+			//
+			//  w =    |------ [w_1] ------|------ [w_2] -------|
+			//  p =      |------- [p_1] ---|--------- [p_2] ----| (1 deletion in [p_1])
+			//              or
+			//    =    |------ [p_1] ------|------ [p_2] -------| (1 match/substitution in [p_1])
+			//        or
+			//    = |------- [p_1] --------|---- [p_2] ---------| (1 insertion in [p_1])
+			//
+			for (std::size_t i = 0; i < num_trav; ++i)
+			{
 				// only search rear kmer if an exact match has not been found for the forward
-				if (!accept_zero_kmer)
+				if (trav[i].accept_zero_kmer) continue;
+
+				uint32_t win_pos = batch_pos[first + i];
+				UCHAR* bv = &bitvec[i * bitvec_size];
+				std::fill(bv, bv + bitvec_size, 0);
+
+				// init the first bitvector window
+				auto ii = win_pos + refstats.partialwin[index.index_num] - 1;
+				init_win_r(&read.isequence[ii],	bv,	bv + 4,	refstats.numbvs[index.index_num]);
+
+				// the hash of the second (rear) half of the kmer window
+				uint32_t keyr = kmer_hash[win_pos + refstats.partialwin[index.index_num]];
+
+				// TODO: remove in production
+				if (index.lookup_tbl_size <= keyr) {
+					size_t vsize = index.lookup_tbl_size;
+					uint16_t idxn = index.index_num;
+					uint16_t idxp = index.part;
+					std::string id = read.id;
+					bool is03 = read.is03;
+					bool is04 = read.is04;
+					ERR("Thread: ", std::this_thread::get_id(), " lookup index: ", keyr, 
+						" is larger than lookup_tbl.size: ", vsize, " Index: ", idxn, " Part: ", idxp, 
+						" Read.id: ", id, " Read.is03: ", is03, " Read.is04: ", is04, " Aborting...");
+					exit(EXIT_FAILURE);
+				}
+
+				// continue subsearch (1)(b)
+				if ( index.lookup_tbl[keyr].count > opts.minoccur && index.lookup_tbl[keyr].trie_R != 0 )
 				{
-					//bitvec.resize(bitvec_size);
-					std::fill(bitvec.begin(), bitvec.end(), 0);
-
-					// init the first bitvector window
-					auto ii = win_pos + refstats.partialwin[index.index_num] - 1;
-					init_win_r(&read.isequence[ii],	&bitvec[0],	&bitvec[4],	refstats.numbvs[index.index_num]);
-
-					// the hash of the second (rear) half of the kmer window
-					uint32_t keyr = read.hashKmer(win_pos + refstats.partialwin[index.index_num], refstats.partialwin[index.index_num]);
-
-					// TODO: remove in production
-					if (index.lookup_tbl.size() <= keyr) {
-						size_t vsize = index.lookup_tbl.size();
-						uint16_t idxn = index.index_num;
-						uint16_t idxp = index.part;
-						std::string id = read.id;
-						bool is03 = read.is03;
-						bool is04 = read.is04;
-						ERR("Thread: ", std::this_thread::get_id(), " lookup index: ", keyr, 
-							" is larger than lookup_tbl.size: ", vsize, " Index: ", idxn, " Part: ", idxp, 
-							" Read.id: ", id, " Read.is03: ", is03, " Read.is04: ", is04, " Aborting...");
-						exit(EXIT_FAILURE);
-					}
+					trav[i].start(index.trie_R(keyr), bv, bv + offset, win_pos, refstats.partialwin[index.index_num]);
+				}
+			}
+			traversetrie_align_batch(trav.data(), num_trav, opts);
 
-					// continue subsearch (1)(b)
-					if ( index.lookup_tbl[keyr].count > opts.minoccur && index.lookup_tbl[keyr].trie_R != NULL )
-					{
-						/* subsearch (1)(b) d([p_1],[w_1]) = 1 and d([p_2],[w_2]) = 0;
-						*
-						*  w =    |------ [w_1] ------|------ [w_2] -------|
-						*  p =      |------- [p_1] ---|--------- [p_2] ----| (1 deletion in [p_1])
-						*              or
-						*    =    |------ [p_1] ------|------ [p_2] -------| (1 match/substitution in [p_1])
-						*        or
-						*    = |------- [p_1] --------|---- [p_2] ---------| (1 insertion in [p_1])
-						*
-						*/
-						traversetrie_align(
-							index.lookup_tbl[keyr].trie_R,
-							0,
-							0,
-							&bitvec[0],
-							&bitvec[offset],
-							accept_zero_kmer,
-							id_hits,
-							win_pos,
-							refstats.partialwin[index.index_num], 
-							opts);
-					}//~if exact half window exists in the reverse burst trie                    
-				}//~if (!accept_zero_kmer)
-
-				// store found seed hits in the read
-				if (!id_hits.empty())
+			// store found seed hits in the read, in the order of the windows
+			for (std::size_t i = 0; i < num_trav; ++i)
+			{
+				if (!trav[i].id_hits.empty())
 				{
-					for (auto const& hit: id_hits)
+					for (auto const& hit: trav[i].id_hits)
 					{
 						read.id_win_hits.push_back(hit);
 					}
 					++read.hit_seeds;
 				}
-			} // ~if not read_pos_searched[win_pos]
+			}
+		} // ~for (each batch of windows)
 
-			// all k-mers for a given shift-size are to be looked up prior proceeding to the LIS/SW calculation
-			if (win_num == numwin - 1)
-			{
-				// calculate LIS if the number of matching seeds on the read meets the threshold (default 2)
-				if (read.hit_seeds >= (uint32_t)opts.num_seeds) {
-					compute_lis_alignment(read, opts, index, refs, readstats, refstats,	search,	max_SW_score);
-				}
+		// all k-mers for a given shift-size are to be looked up prior proceeding to the LIS/SW calculation
+		// calculate LIS if the number of matching seeds on the read meets the threshold (default 2)
+		if (read.hit_seeds >= (uint32_t)opts.num_seeds) {
+			compute_lis_alignment(read, opts, index, refs, readstats, refstats,	search,	max_SW_score, ws);
+		}
 
-				// if the read was not accepted at the current shift,
-				// use the next (smaller) window shift
-				if (search)
-				{
-					if (pass_n == 2) 
-						search = false; // the last (3rd) Pass has been made
-					else
-					{
-						// the next interval size equals to the current one, skip it
-						while (pass_n < 3
-							&& opts.skiplengths[index.index_num][pass_n] == 
-								opts.skiplengths[index.index_num][pass_n + 1])
-							++pass_n;
-						if (++pass_n > 2) search = false;
-						// set interval skip length for next Pass
-						else win_shift = opts.skiplengths[index.index_num][pass_n];
-					}
-				}
-				break; // go to the next shift size
-			}//~( win_num == NUMWIN-1 )
-			win_pos += win_shift;
-		}//~for (each window)                
-			//~while all skip/shift lengths have not been tested, or a match has not been found
+		// if the read was not accepted at the current shift,
+		// use the next (smaller) window shift
+		if (search)
+		{
+			if (pass_n == 2) 
+				search = false; // the last (3rd) Pass has been made
+			else
+			{
+				// the next interval size equals to the current one, skip it
+				while (pass_n < 3
+					&& opts.skiplengths[index.index_num][pass_n] == 
+						opts.skiplengths[index.index_num][pass_n + 1])
+					++pass_n;
+				if (++pass_n > 2) search = false;
+				// set interval skip length for next Pass
+				else win_shift = opts.skiplengths[index.index_num][pass_n];
+			}
+		}
+		//~while all skip/shift lengths have not been tested, or a match has not been found
 	}// ~while (search);
 
 	// all_N_best_max_SW Or all_N hits found - stop further processing of this read
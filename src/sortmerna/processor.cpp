@@ -70,6 +70,10 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include <chrono>
 #include <thread> // std::this_thread
 #include <cmath> // std::floor
+#include <filesystem>
+#include <system_error>
+#include <utility> // std::swap
+#include <memory> // std::unique_ptr
 
 #include "processor.hpp"
 #include "read.hpp"
@@ -79,10 +83,14 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include "readstats.hpp"
 #include "refstats.hpp"
 #include "options.hpp"
+#include "kvdb.hpp"
+#include "workspace.hpp"
+#include "dedup.hpp"
+#include "readcache.hpp"
 //#include "readsqueue.hpp"
 
 // forward
-void traverse(Runopts& opts, Index& index, References& refs, Readstats& readstats, Refstats& refstats, Read& read, bool isLastStrand);
+void traverse(Runopts& opts, Index& index, References& refs, Readstats& readstats, Refstats& refstats, Read& read, bool isLastStrand, Workspace& ws);
 
 /*
 * performs the alignment
@@ -91,13 +99,22 @@ void traverse(Runopts& opts, Index& index, References& refs, Readstats& readstat
 *  @param is_last_idx  flags the last index is being processed
 */
 void align2(int id, Readfeed& readfeed, Readstats& readstats, 
-			Index& index, References& refs, Refstats& refstats, KeyValueDatabase& kvdb, Runopts& opts)
+			Index& index, References& refs, Refstats& refstats, KeyValueDatabase& kvdb, Runopts& opts, Dedup* dedup, ReadCache* cache)
 {
 	unsigned num_all = 0; // all reads this processor sees
 	unsigned num_skipped = 0; // reads already processed i.e. results found in Database
+	unsigned num_dup = 0; // duplicate reads i.e. aligned with their representative (OPT_DEDUP)
 	unsigned num_hit = 0; // count of reads with read.hit = true found by a single thread - just for logging
+	unsigned num_cache_get = 0; // reads looked up in the results cache (OPT_READ_CACHE)
+	unsigned num_cache_hit = 0; // reads which search results were found in the cache
 	std::string readstr;
 
+	Workspace ws(opts); // search scratch buffers reused for all the reads of this thread
+	KvdbBatch kvdb_batch(kvdb); // the results of this thread, written when the batch is full and flushed once more when out of scope
+#ifdef SMR_ALLOC_COUNTER
+	uint64_t num_alloc = 0; // heap allocations made during the read search
+#endif
+
 	auto starts = std::chrono::high_resolution_clock::now();
 	INFO("Processor ", id, " thread ", std::this_thread::get_id(), " started");
 	int idx = id * readfeed.num_sense; // index into split files array
@@ -113,7 +130,14 @@ void align2(int id, Readfeed& readfeed, Readstats& readstats,
 				readstats.num_short.fetch_add(1, std::memory_order_relaxed);
 			}
 
-			if (read.isValid) {
+			// the copies are recorded once, in the first index part, see 'Dedup::store_copies'
+			uint32_t num_copies = 0; // copies of this read, counted in the Readstats with it
+			if (read.isValid && dedup && dedup->is_copy(read, index.index_num == 0 && index.part == 0, num_copies)) {
+				read.isValid = false;
+				++num_dup;
+			}
+
+			if (read.isValid && readstats.is_stored(read.readfile_idx, read.read_num)) {
 				read.load_db(kvdb);
 			}
 
@@ -133,25 +157,69 @@ void align2(int id, Readfeed& readfeed, Readstats& readstats,
 			else
 				num_strands = 2; // search both strands. The default when neither -F or -R were specified
 
-			//                                                  |- stop if read was aligned on FWD strand
-			for (int count = 0; count < num_strands && !read.is_done; ++count)
-			{
-				if ((search_single_strand && opts.is_reverse) || count == 1)
+			const bool was_hit = read.is_hit;
+
+			// a repeated read gets the results of its earlier search against this index part
+			ReadCache::Key cache_key;
+			ReadCache::Value cached;
+			bool is_cached = false;
+			if (cache) {
+				cache_key = ReadCache::make_key(read, read.toBinString(), index.index_num, index.part);
+				is_cached = cache->get(cache_key, cached);
+				++num_cache_get;
+			}
+
+			if (is_cached) {
+				++num_cache_hit;
+				if (cached.is_new_hit) {
+					read.fromBinString(cached.bstr);
+					read.is_new_hit = true;
+				}
+				if (cached.is_first_hit) {
+					readstats.num_aligned.fetch_add(1, std::memory_order_relaxed);
+					++readstats.reads_matched_per_db[index.index_num];
+				}
+			}
+			else {
+				read.id_win_hits.swap(ws.win_hits); // collect the seed hits into the thread's buffer
+#ifdef SMR_ALLOC_COUNTER
+				auto alloc_start = thread_alloc_count();
+#endif
+				//                                                  |- stop if read was aligned on FWD strand
+				for (int count = 0; count < num_strands && !read.is_done; ++count)
 				{
-					if (!read.reversed)
-						read.revIntStr();
+					if ((search_single_strand && opts.is_reverse) || count == 1)
+					{
+						if (!read.reversed)
+							read.revIntStr();
+					}
+					
+					traverse(opts, index, refs, readstats, refstats, read, search_single_strand || count == 1, ws); // 'paralleltraversal.cpp'
+					read.id_win_hits.clear(); // bug 46
 				}
-				
-				traverse(opts, index, refs, readstats, refstats, read, search_single_strand || count == 1); // 'paralleltraversal.cpp'
-				read.id_win_hits.clear(); // bug 46
+#ifdef SMR_ALLOC_COUNTER
+				num_alloc += thread_alloc_count() - alloc_start;
+#endif
+				read.id_win_hits.swap(ws.win_hits);
+
+				if (cache)
+					cache->put(cache_key, { read.is_new_hit ? read.toBinString() : "", read.is_new_hit, !was_hit && read.is_hit });
+			}
+
+			// the copies are aligned the first time the read is, see 'compute_lis_alignment'
+			if (num_copies > 0 && !was_hit && read.is_hit) {
+				readstats.num_aligned.fetch_add(num_copies, std::memory_order_relaxed);
+				readstats.reads_matched_per_db[index.index_num] += num_copies;
 			}
 
 			// write to DB - thread safe
 			if (read.isValid && !read.isEmpty)
 			{
 				if (read.is_hit) ++num_hit;
-				if (read.is_new_hit)
-					kvdb.put(read.id, read.toBinString());
+				if (read.is_new_hit) {
+					kvdb_batch.put(read.key(), read.toBinString());
+					readstats.set_hit(read.readfile_idx, read.read_num);
+				}
 			}
 
 			readstr.resize(0);
@@ -164,11 +232,244 @@ void align2(int id, Readfeed& readfeed, Readstats& readstats,
 	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - starts;
 	INFO("Processor ", id, " thread ", std::this_thread::get_id(), " done. Processed ",
 		num_all, " reads. Skipped already processed: ", num_skipped, " reads", 
-		" Aligned reads (passing E-value): ", num_hit, " Runtime sec: ", elapsed.count());
+		" Aligned reads (passing E-value): ", num_hit,
+		cache ? fold_to_string(" Cache hits: ", num_cache_hit, " of ", num_cache_get, " (",
+			num_cache_get > 0 ? 100.0 * num_cache_hit / num_cache_get : 0.0, "%)") : "",
+		" Runtime sec: ", elapsed.count());
+	if (dedup)
+		INFO("Processor ", id, " duplicate reads skipped: ", num_dup);
+	if (opts.xdrop_lossy > 0)
+		INFO("Processor ", id, " lossy X-drop heuristic skipped ", ws.num_xdrop_skipped, " of ", ws.num_xdrop, " SW windows");
+#ifdef SMR_ALLOC_COUNTER
+	INFO("Processor ", id, " heap allocations in the read search: ", num_alloc,
+		" per read: ", num_all > 0 ? static_cast<double>(num_alloc) / num_all : 0.0);
+#endif
 } // ~align2
 
+/*
+* estimated memory in bytes taken by the given index part and its references when loaded
+*/
+static uint64_t part_mem_size(uint16_t idx_num, uint16_t idx_part, Runopts& opts, Refstats& refstats)
+{
+	std::error_code ec;
+	auto idx_bytes = std::filesystem::file_size(opts.indexfiles[idx_num].second + ".idx_" + std::to_string(idx_part) + ".dat", ec);
+	if (ec) idx_bytes = 0;
+	return idx_bytes + refstats.index_parts_stats_vec[idx_num][idx_part].seq_part_size;
+} // ~part_mem_size
+
+/*
+* reads-major variant of align2: searches each read against all the index parts in a single pass.
+* The read state between the parts is kept in its serialized form, exactly as it would be
+* restored from the Database in the per-part mode, and is stored to the Database only once.
+*  runs in a thread.  align_all_parts -> align2_all_parts
+*/
+void align2_all_parts(int id, Readfeed& readfeed, Readstats& readstats, 
+			std::vector<std::unique_ptr<Index>>& indices, std::vector<References>& refs, 
+			Refstats& refstats, KeyValueDatabase& kvdb, Runopts& opts, Dedup* dedup, ReadCache* cache)
+{
+	unsigned num_all = 0; // all reads this processor sees
+	unsigned num_skipped = 0; // reads already processed i.e. results found in Database
+	unsigned num_dup = 0; // duplicate reads i.e. aligned with their representative (OPT_DEDUP)
+	unsigned num_hit = 0; // count of reads with read.hit = true found by a single thread - just for logging
+	unsigned num_cache_get = 0; // reads looked up in the results cache (OPT_READ_CACHE)
+	unsigned num_cache_hit = 0; // reads which search results were found in the cache
+	std::string readstr;
+	std::string bstr; // read alignment data carried from one index part to the next
+	bool search_single_strand = opts.is_forward ^ opts.is_reverse; // search only a single strand
+	int num_strands = search_single_strand ? 1 : 2;
+
+	Workspace ws(opts); // search scratch buffers reused for all the reads of this thread
+	KvdbBatch kvdb_batch(kvdb); // the results of this thread, written when the batch is full and flushed once more when out of scope
+#ifdef SMR_ALLOC_COUNTER
+	uint64_t num_alloc = 0; // heap allocations made during the read search
+#endif
+
+	auto starts = std::chrono::high_resolution_clock::now();
+	INFO("Processor ", id, " thread ", std::this_thread::get_id(), " started");
+	int idx = id * readfeed.num_sense; // index into split files array
+	for (; readfeed.next(idx, readstr);)
+	{
+		{
+			Read read_init(readstr);
+			read_init.init(opts);
+
+			// short reads are counted against the last index, same as in the per-part mode
+			if (read_init.sequence.size() < refstats.lnwin[indices.back()->index_num])
+				readstats.num_short.fetch_add(1, std::memory_order_relaxed);
+
+			uint32_t num_copies = 0; // copies of this read, counted in the Readstats with it
+			const bool is_copy = dedup && !read_init.isEmpty && dedup->is_copy(read_init, true, num_copies);
+			if (is_copy)
+				++num_dup;
+
+			bstr.clear();
+			if (!read_init.isEmpty && !is_copy && readstats.is_stored(read_init.readfile_idx, read_init.read_num))
+				bstr = kvdb.get(read_init.key());
+			bool is_new_hit = false; // store to DB
+			bool is_hit = false;
+
+			for (std::size_t i = 0; !is_copy && i < indices.size(); ++i)
+			{
+				Read read(read_init);
+				read.is_too_short = read.sequence.size() < refstats.lnwin[indices[i]->index_num];
+				if (read.is_too_short)
+					read.isValid = false;
+
+				if (read.isValid)
+					read.fromBinString(bstr);
+
+				if (read.isEmpty || !read.isValid || read.is_done) {
+					if (read.is_done) {
+						++num_skipped;
+						break;
+					}
+					continue;
+				}
+
+				const bool was_hit = read.is_hit;
+
+				// a repeated read gets the results of its earlier search against this index part
+				ReadCache::Key cache_key;
+				ReadCache::Value cached;
+				bool is_cached = false;
+				if (cache) {
+					cache_key = ReadCache::make_key(read, bstr, indices[i]->index_num, indices[i]->part);
+					is_cached = cache->get(cache_key, cached);
+					++num_cache_get;
+				}
+
+				if (is_cached) {
+					++num_cache_hit;
+					if (cached.is_new_hit) {
+						read.fromBinString(cached.bstr);
+						read.is_new_hit = true;
+					}
+					if (cached.is_first_hit) {
+						readstats.num_aligned.fetch_add(1, std::memory_order_relaxed);
+						++readstats.reads_matched_per_db[indices[i]->index_num];
+					}
+				}
+				else {
+					read.id_win_hits.swap(ws.win_hits); // collect the seed hits into the thread's buffer
+#ifdef SMR_ALLOC_COUNTER
+					auto alloc_start = thread_alloc_count();
+#endif
+					//                                                  |- stop if read was aligned on FWD strand
+					for (int count = 0; count < num_strands && !read.is_done; ++count)
+					{
+						if ((search_single_strand && opts.is_reverse) || count == 1)
+						{
+							if (!read.reversed)
+								read.revIntStr();
+						}
+	
+						traverse(opts, *indices[i], refs[i], readstats, refstats, read, search_single_strand || count == 1, ws); // 'paralleltraversal.cpp'
+						read.id_win_hits.clear(); // bug 46
+					}
+#ifdef SMR_ALLOC_COUNTER
+					num_alloc += thread_alloc_count() - alloc_start;
+#endif
+					read.id_win_hits.swap(ws.win_hits);
+
+					if (cache)
+						cache->put(cache_key, { read.is_new_hit ? read.toBinString() : "", read.is_new_hit, !was_hit && read.is_hit });
+				}
+
+				// the copies are aligned the first time the read is, see 'compute_lis_alignment'
+				if (num_copies > 0 && !was_hit && read.is_hit) {
+					readstats.num_aligned.fetch_add(num_copies, std::memory_order_relaxed);
+					readstats.reads_matched_per_db[indices[i]->index_num] += num_copies;
+				}
+
+				is_hit = read.is_hit;
+				if (read.is_new_hit) {
+					bstr = read.toBinString();
+					is_new_hit = true;
+				}
+			} // ~for(indices)
+
+			// write to DB - thread safe
+			if (is_hit) ++num_hit;
+			if (is_new_hit) {
+				kvdb_batch.put(read_init.key(), bstr);
+				readstats.set_hit(read_init.readfile_idx, read_init.read_num);
+			}
+
+			readstr.resize(0);
+			++num_all;
+		} // ~if & read destroyed
+
+		if (opts.is_paired) idx ^= 1; // switch FWD-REV
+	} // ~while there are reads
+
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - starts;
+	INFO("Processor ", id, " thread ", std::this_thread::get_id(), " done. Processed ",
+		num_all, " reads. Skipped already processed: ", num_skipped, " reads", 
+		" Aligned reads (passing E-value): ", num_hit,
+		cache ? fold_to_string(" Cache hits: ", num_cache_hit, " of ", num_cache_get, " (",
+			num_cache_get > 0 ? 100.0 * num_cache_hit / num_cache_get : 0.0, "%)") : "",
+		" Runtime sec: ", elapsed.count());
+	if (dedup)
+		INFO("Processor ", id, " duplicate reads skipped: ", num_dup);
+	if (opts.xdrop_lossy > 0)
+		INFO("Processor ", id, " lossy X-drop heuristic skipped ", ws.num_xdrop_skipped, " of ", ws.num_xdrop, " SW windows");
+#ifdef SMR_ALLOC_COUNTER
+	INFO("Processor ", id, " heap allocations in the read search: ", num_alloc,
+		" per read: ", num_all > 0 ? static_cast<double>(num_alloc) / num_all : 0.0);
+#endif
+} // ~align2_all_parts
+
+/*
+* loads all the index parts and their references, and runs a single pass over the reads
+*/
+static void align_all_parts(Readfeed& readfeed, Readstats& readstats, Refstats& refstats, KeyValueDatabase& kvdb, 
+	Runopts& opts, std::vector<std::pair<uint16_t, uint16_t>>& parts, Dedup* dedup, ReadCache* cache)
+{
+	std::vector<std::unique_ptr<Index>> indices;
+	std::vector<References> refs(parts.size());
+
+	auto start_i = std::chrono::high_resolution_clock::now();
+	for (std::size_t i = 0; i < parts.size(); ++i)
+	{
+		INFO("Loading index: ", parts[i].first, " part: ", parts[i].second + 1, "/", refstats.num_index_parts[parts[i].first], " and its references ... ");
+		indices.emplace_back(new Index());
+		indices[i]->load(parts[i].first, parts[i].second, opts.indexfiles, refstats);
+		refs[i].load(parts[i].first, parts[i].second, opts, refstats);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start_i;
+	INFO_MEM("Loaded all ", parts.size(), " index parts in [", elapsed.count(), "] sec");
+
+	readstats.num_short.store(0, std::memory_order_relaxed); // reset the short reads counter
+
+	start_i = std::chrono::high_resolution_clock::now();
+	std::vector<std::thread> tpool;
+	tpool.reserve(opts.num_proc_thread);
+	for (unsigned i = 0; i < opts.num_proc_thread; i++)
+	{
+		tpool.emplace_back(std::thread(align2_all_parts, i, std::ref(readfeed), 
+							std::ref(readstats), std::ref(indices), std::ref(refs), 
+							std::ref(refstats), std::ref(kvdb), std::ref(opts), dedup, cache));
+	}
+	for (auto& thr: tpool) {
+		thr.join();
+	}
+	elapsed = std::chrono::high_resolution_clock::now() - start_i;
+	INFO_MEM("done all index parts in ", elapsed.count(), " sec");
+
+	for (std::size_t i = 0; i < parts.size(); ++i)
+	{
+		indices[i]->unload();
+		refs[i].unload();
+	}
+	readfeed.rewind_in();
+	readfeed.init_vzlib_in();
+} // ~align_all_parts
+
 /*
 * launches processing threads. called from main
+*  Loading of the index part N+1 overlaps with the alignment against the part N
+*  as long as both parts fit into the memory limit '-m'.
+*  With '--reads_major' all the parts are loaded up front and the reads are read once.
 */
 void align(Readfeed& readfeed, Readstats& readstats, Index& index, KeyValueDatabase& kvdb, Runopts& opts)
 {
@@ -206,35 +507,127 @@ void align(Readfeed& readfeed, Readstats& readstats, Index& index, KeyValueDatab
 	std::vector<std::thread> tpool;
 	tpool.reserve(numThreads);
 
+	// find the duplicate reads, so that only one read per distinct sequence is aligned
+	std::unique_ptr<Dedup> dedup;
+	if (opts.is_dedup)
+	{
+		dedup.reset(new Dedup(opts));
+		dedup->run(readfeed);
+	}
+
+	// reads with results in the KVDB. The reads without results are not looked up
+	readstats.init_hits(readfeed.num_split_files);
+
+	// search results of the repeated reads shared by the threads
+	std::unique_ptr<ReadCache> cache;
+	if (opts.read_cache > 0)
+		cache.reset(new ReadCache(opts.read_cache));
+
 	Refstats refstats(opts, readstats);
-	References refs;
 
-	int loopCount = 0; // counter of total number of processing iterations
+	// all the index parts in the processing order
+	std::vector<std::pair<uint16_t, uint16_t>> parts; // [<idx_num, idx_part>]
+	for (uint16_t idx_num = 0; idx_num < opts.indexfiles.size(); ++idx_num)
+		for (uint16_t idx_part = 0; idx_part < refstats.num_index_parts[idx_num]; ++idx_part)
+			parts.emplace_back(idx_num, idx_part);
+
+	// reads-major mode needs all the parts in memory at once
+	bool is_all_parts = false;
+	if (opts.is_reads_major)
+	{
+		uint64_t mem = 0;
+		for (auto const& pt : parts)
+			mem += part_mem_size(pt.first, pt.second, opts, refstats);
+		double mem_mb = mem / 1048576.0;
+		if (mem_mb <= opts.max_file_size)
+			is_all_parts = true;
+		else
+			WARN("'", OPT_READS_MAJOR, "' needs ", mem_mb, " MB to keep all the index parts in memory, which exceeds the memory limit ",
+				opts.max_file_size, " MB ('", OPT_M, "'). Aligning one index part at a time.");
+	}
 
 	// perform alignment
 	auto start_a = std::chrono::high_resolution_clock::now();
 	std::chrono::duration<double> elapsed;
 
-	// loop through every index passed to option '--ref'
-	for (size_t idx_num = 0; idx_num < opts.indexfiles.size(); ++idx_num)
+	if (is_all_parts)
 	{
-		// iterate every part of an index
-		for (uint16_t idx_part = 0; idx_part < refstats.num_index_parts[idx_num]; ++idx_part)
+		align_all_parts(readfeed, readstats, refstats, kvdb, opts, parts, dedup.get(), cache.get());
+	}
+	else
+	{
+		// Two Index/References buffers: the workers search the 'current' pair while
+		// the loader thread fills the 'next' pair with the following index part.
+		Index index_next;
+		References refs_buf[2];
+		Index* index_cur = &index;
+		Index* index_nxt = &index_next;
+		References* refs_cur = &refs_buf[0];
+		References* refs_nxt = &refs_buf[1];
+
+		std::thread loader;
+		bool is_prefetched = false; // the next part is being loaded by the loader thread
+		double loader_sec = 0; // loading time of the prefetched part
+
+		int loopCount = 0; // counter of total number of processing iterations
+
+		// loop through every part of every index passed to option '--ref'
+		for (std::size_t ipart = 0; ipart < parts.size(); ++ipart)
 		{
-			// load index
-			INFO("Loading index: ", idx_num, " part: ", idx_part + 1, "/", refstats.num_index_parts[idx_num], " Memory KB: ", (get_memory() >> 10), " ... ");
+			auto idx_num = parts[ipart].first;
+			auto idx_part = parts[ipart].second;
 			auto start_i = std::chrono::high_resolution_clock::now();
-			index.load(idx_num, idx_part, opts.indexfiles, refstats);
+			if (is_prefetched)
+			{
+				// wait for the loader. Only stalls if loading is slower than the alignment of the previous part
+				INFO("Waiting for prefetched index: ", idx_num, " part: ", idx_part + 1, "/", refstats.num_index_parts[idx_num], " ... ");
+				loader.join();
+				std::swap(index_cur, index_nxt);
+				std::swap(refs_cur, refs_nxt);
+				elapsed = std::chrono::high_resolution_clock::now() - start_i;
+				INFO_MEM("done. Loaded in background in [", loader_sec, "] sec. Waited [", elapsed.count(), "] sec");
+			}
+			else
+			{
+				// load index
+				INFO("Loading index: ", idx_num, " part: ", idx_part + 1, "/", refstats.num_index_parts[idx_num], " Memory KB: ", (get_memory() >> 10), " ... ");
+				index_cur->load(idx_num, idx_part, opts.indexfiles, refstats);
+				elapsed = std::chrono::high_resolution_clock::now() - start_i; // ~20 sec Debug/Win
+				INFO_MEM("done in [", elapsed.count(), "] sec");
+
+				// load references
+				INFO("Loading references ...");
+				start_i = std::chrono::high_resolution_clock::now();
+				refs_cur->load(idx_num, idx_part, opts, refstats);
+				elapsed = std::chrono::high_resolution_clock::now() - start_i; // ~20 sec Debug/Win
+				INFO_MEM("done in [", elapsed.count(), "] sec.");
+			}
 			readstats.num_short.store(0, std::memory_order_relaxed); // reset the short reads counter
-			elapsed = std::chrono::high_resolution_clock::now() - start_i; // ~20 sec Debug/Win
-			INFO_MEM("done in [", elapsed.count(), "] sec");
 
-			// load references
-			INFO("Loading references ...");
-			start_i = std::chrono::high_resolution_clock::now();
-			refs.load(idx_num, idx_part, opts, refstats);
-			elapsed = std::chrono::high_resolution_clock::now() - start_i; // ~20 sec Debug/Win
-			INFO_MEM("done in [", elapsed.count(), "] sec.");
+			// prefetch the next part if both parts fit into the memory limit '-m'
+			is_prefetched = false;
+			if (ipart + 1 < parts.size())
+			{
+				auto next_num = parts[ipart + 1].first;
+				auto next_part = parts[ipart + 1].second;
+				double mem_mb = (part_mem_size(idx_num, idx_part, opts, refstats) + part_mem_size(next_num, next_part, opts, refstats)) / 1048576.0;
+				if (mem_mb <= opts.max_file_size)
+				{
+					INFO("Prefetching index: ", next_num, " part: ", next_part + 1, "/", refstats.num_index_parts[next_num], " in background");
+					loader = std::thread([&, next_num, next_part]() {
+						auto start_l = std::chrono::high_resolution_clock::now();
+						index_nxt->load(next_num, next_part, opts.indexfiles, refstats);
+						index_nxt->prefault();
+						refs_nxt->load(next_num, next_part, opts, refstats);
+						std::chrono::duration<double> elapsed_l = std::chrono::high_resolution_clock::now() - start_l;
+						loader_sec = elapsed_l.count();
+					});
+					is_prefetched = true;
+				}
+				else
+					INFO("Not prefetching the next index part: current and next parts need ", mem_mb,
+						" MB, which exceeds the memory limit ", opts.max_file_size, " MB ('", OPT_M, "')");
+			}
 
 			start_i = std::chrono::high_resolution_clock::now();
 
@@ -248,8 +641,8 @@ void align(Readfeed& readfeed, Readstats& readstats, Index& index, KeyValueDatab
 			for (int i = 0; i < numProcThread; i++)
 			{
 				tpool.emplace_back(std::thread(align2, i, std::ref(readfeed), 
-                                    std::ref(readstats), std::ref(index), std::ref(refs), 
-                                    std::ref(refstats),  std::ref(kvdb), std::ref(opts)));
+	                                std::ref(readstats), std::ref(*index_cur), std::ref(*refs_cur), 
+	                                std::ref(refstats),  std::ref(kvdb), std::ref(opts), dedup.get(), cache.get()));
 			}
 			for (auto& thr: tpool) {
 				thr.join();
@@ -262,23 +655,30 @@ void align(Readfeed& readfeed, Readstats& readstats, Index& index, KeyValueDatab
 			//INFO_MEM("Done index ", idx_num, " Part: ", idx_part + 1, " Queue size: ", read_queue.queue.size_approx(), " Time: ", elapsed.count())
 
 			start_i = std::chrono::high_resolution_clock::now();
-			index.unload();
-			refs.unload();
+			index_cur->unload();
+			refs_cur->unload();
 			elapsed = std::chrono::high_resolution_clock::now() - start_i;
 			INFO_MEM("Index and References unloaded in ", elapsed.count(), " sec.");
 			tpool.clear();
+			if (cache)
+				cache->clear(); // the results are of this index part
 			// rewind for the next index
 			readfeed.rewind_in();
-            // does nothing for indexed feed. Only for split reads feed. 
-            // TODO: remove this call after removing split reads feed.
+	        // does nothing for indexed feed. Only for split reads feed. 
+	        // TODO: remove this call after removing split reads feed.
 			readfeed.init_vzlib_in();   
 			//read_queue.reset();
-		} // ~for(idx_part)
-	} // ~for(idx_num)
+		} // ~for(parts)
+	}
+
 
 	elapsed = std::chrono::high_resolution_clock::now() - start_a;
 	INFO("==== Done alignment in ", elapsed.count(), " sec ====\n");
 
+	// results of the duplicate reads
+	if (dedup)
+		dedup->store_copies(kvdb, readstats, elapsed.count());
+
 	// store readstats calculated in alignment
 	readstats.set_is_set_aligned_id_cov();
 	readstats.store_to_db(kvdb);
@@ -296,6 +696,8 @@ void denovo_stats_run(const uint32_t& id,
 	uint16_t num_reads = opts.is_paired ? 2 : 1;
 	std::string readstr;
 	std::vector<Read> reads; // two reads if paired, a single read otherwise
+	KvdbBatch kvdb_batch(kvdb); // the updated reads, written when the batch is full and flushed once more when out of scope
+	KvdbCursor cursors[2] = { kvdb, kvdb }; // the reads of a thread come in the order of the keys, per reads file
 
 	if (opts.dbg_level == 2)
 		INFO_MEM("Denovo stats thread ", id, " : ", std::this_thread::get_id(), " started.");
@@ -310,7 +712,8 @@ void denovo_stats_run(const uint32_t& id,
 			{
 				reads.emplace_back(Read(readstr));
 				reads[i].init(opts);
-				reads[i].load_db(kvdb);
+				if (readstats.is_stored(reads[i].readfile_idx, reads[i].read_num))
+					reads[i].load_db(cursors[i]);
 				readstr.resize(0);
 				++countReads;
 			}
@@ -355,7 +758,7 @@ void denovo_stats_run(const uint32_t& id,
 						}
 					}
 				}
-				kvdb.put(read.id, read.toBinString()); // store to DB
+				kvdb_batch.put(read.key(), read.toBinString()); // store to DB
 			} // ~for reads
 		} // ~ if !is_done
 	} // ~for
@@ -44,6 +44,92 @@ along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
 #include "read.hpp"
 #include "references.hpp"
 
+namespace {
+
+/* LEB128: 7 bits per byte, the low bits first */
+inline void put_varint(std::string& buf, uint64_t val)
+{
+	for (; val >= 0x80; val >>= 7)
+		buf.push_back(static_cast<char>(val | 0x80));
+	buf.push_back(static_cast<char>(val));
+}
+
+/* signed to unsigned so that the small magnitudes are short varints: 0, -1, 1, -2 -> 0, 1, 2, 3 */
+inline uint64_t zigzag(int64_t val) { return (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63); }
+inline int64_t unzigzag(uint64_t val) { return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1); }
+
+/* bounds checked parser of a record. Past the end 'ok' is false and the values are 0 */
+struct RecReader
+{
+	const unsigned char* pos;
+	const unsigned char* end;
+	bool ok = true;
+
+	uint64_t left() const { return static_cast<uint64_t>(end - pos); }
+
+	uint8_t byte()
+	{
+		if (pos == end) { ok = false; return 0; }
+		return *pos++;
+	}
+
+	uint64_t varint()
+	{
+		uint64_t val = 0;
+		for (unsigned shift = 0; shift < 64 && pos != end; shift += 7)
+		{
+			uint8_t b = *pos++;
+			val |= static_cast<uint64_t>(b & 0x7f) << shift;
+			if ((b & 0x80) == 0)
+				return val;
+		}
+		ok = false;
+		return 0;
+	}
+};
+
+/* true if 'bstr' is exactly one record of the layout before READ_REC_V1 (see 'Read::fromBinStringV0') */
+bool is_v0_record(std::string_view bstr)
+{
+	const std::size_t head_size = sizeof(Read::lastIndex) + sizeof(Read::lastPart) + sizeof(Read::c_yid_ycov)
+		+ sizeof(Read::n_yid_ncov) + sizeof(Read::n_nid_ycov) + sizeof(Read::n_denovo) + sizeof(Read::is_done)
+		+ sizeof(Read::is_hit) + sizeof(Read::null_align_output) + sizeof(Read::max_SW_count)
+		+ sizeof(Read::num_alignments) + sizeof(Read::hit_seeds);
+	const std::size_t align_head_size = sizeof(std::size_t) + s_align2().size(); // cigar size | fixed fields
+	auto get_size = [&bstr](std::size_t offset) {
+		std::size_t val = 0;
+		std::memcpy(static_cast<void*>(&val), bstr.data() + offset, sizeof(val));
+		return val;
+	};
+
+	// head | alignment size | min_index | max_index | number of alignments
+	std::size_t offset = head_size;
+	if (bstr.size() < offset + sizeof(std::size_t) 
+		|| get_size(offset) != bstr.size() - offset - sizeof(std::size_t))
+		return false;
+	offset += sizeof(std::size_t) + sizeof(alignment_struct2::min_index) + sizeof(alignment_struct2::max_index);
+	if (bstr.size() < offset + sizeof(std::size_t))
+		return false;
+	std::size_t num_align = get_size(offset);
+	offset += sizeof(std::size_t);
+	// each alignment: size | cigar size | cigar | fixed fields
+	for (std::size_t i = 0; i < num_align; ++i)
+	{
+		if (bstr.size() - offset < sizeof(std::size_t) + align_head_size)
+			return false;
+		std::size_t align_size = get_size(offset);
+		offset += sizeof(std::size_t);
+		if (align_size < align_head_size || align_size > bstr.size() - offset
+			|| get_size(offset) != (align_size - align_head_size) / sizeof(uint32_t)
+			|| (align_size - align_head_size) % sizeof(uint32_t) != 0)
+			return false;
+		offset += align_size;
+	}
+	return offset == bstr.size();
+} // ~is_v0_record
+
+} // ~namespace
+
 alignment_struct2::alignment_struct2() : max_size(0), min_index(0), max_index(0) 
 {}
 
@@ -376,6 +462,17 @@ std::string Read::getSeqId() {
 	return id;
 }
 
+std::string Read::get04Seq()
+{
+	std::string seq04 = isequence;
+	if (is03)
+	{
+		for (auto pos : ambiguous_nt)
+			seq04[reversed ? seq04.size() - pos - 1 : pos] = 4;
+	}
+	return seq04;
+} // ~Read::get04Seq
+
 void Read::flip34()
 {
 	if (ambiguous_nt.size() > 0)
@@ -431,32 +528,39 @@ std::string Read::toBinString()
 	if (alignment.alignv.size() == 0)
 		return "";
 
-	// hit, hit_denovo, null_align_output, max_SW_count, num_alignments, readhit, best
 	std::string buf;
-	std::copy_n(static_cast<char*>(static_cast<void*>(&lastIndex)), sizeof(lastIndex), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&lastPart)), sizeof(lastPart), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&c_yid_ycov)), sizeof(c_yid_ycov), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&n_yid_ncov)), sizeof(n_yid_ncov), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&n_nid_ycov)), sizeof(n_nid_ycov), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&n_denovo)), sizeof(n_denovo), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&is_done)), sizeof(is_done), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&is_hit)), sizeof(is_hit), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&null_align_output)), sizeof(null_align_output), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&max_SW_count)), sizeof(max_SW_count), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&num_alignments)), sizeof(num_alignments), std::back_inserter(buf));
-	std::copy_n(static_cast<char*>(static_cast<void*>(&hit_seeds)), sizeof(hit_seeds), std::back_inserter(buf));
-
-	// id_win_hits vector - TODO: remove?
-#if 0
-	size_t id_win_hits_size = id_win_hits.size();
-	std::copy_n(static_cast<char*>(static_cast<void*>(&id_win_hits_size)), sizeof(id_win_hits_size), std::back_inserter(buf)); // add vector size
-	for (auto it = id_win_hits.begin(); it != id_win_hits.end(); ++it) buf += it->toString(); // add values
-#endif
-	// alignment
-	std::string alignment_str = alignment.toString();
-	size_t alignment_size = alignment_str.length();
-	std::copy_n(static_cast<char*>(static_cast<void*>(&alignment_size)), sizeof(alignment_size), std::back_inserter(buf)); // add size
-	buf += alignment_str; //  add string
+	buf.reserve(32 + alignment.alignv.size() * 32);
+	buf.push_back(static_cast<char>(READ_REC_V1));
+	put_varint(buf, lastIndex);
+	put_varint(buf, lastPart);
+	put_varint(buf, c_yid_ycov);
+	put_varint(buf, n_yid_ncov);
+	put_varint(buf, n_nid_ycov);
+	put_varint(buf, n_denovo);
+	buf.push_back(static_cast<char>(is_done | is_hit << 1 | null_align_output << 2));
+	put_varint(buf, max_SW_count);
+	put_varint(buf, zigzag(num_alignments));
+	put_varint(buf, hit_seeds);
+
+	put_varint(buf, alignment.min_index);
+	put_varint(buf, alignment.max_index);
+	put_varint(buf, alignment.alignv.size());
+	for (auto const& align : alignment.alignv)
+	{
+		put_varint(buf, align.index_num);
+		put_varint(buf, align.part);
+		put_varint(buf, align.ref_num);
+		put_varint(buf, zigzag(align.ref_begin1));
+		put_varint(buf, zigzag(static_cast<int64_t>(align.ref_end1) - align.ref_begin1));
+		put_varint(buf, zigzag(align.read_begin1));
+		put_varint(buf, zigzag(static_cast<int64_t>(align.read_end1) - align.read_begin1));
+		put_varint(buf, align.readlen);
+		put_varint(buf, align.score1);
+		buf.push_back(static_cast<char>(align.strand));
+		put_varint(buf, align.cigar.size());
+		for (auto const& op : align.cigar)
+			put_varint(buf, op); // length << 4 | op: 1 byte for the lengths up to 7, 2 bytes up to 1023
+	}
 
 	return buf;
 } // ~Read::toBinString
@@ -466,8 +570,117 @@ std::string Read::toBinString()
  */
 bool Read::load_db(KeyValueDatabase& kvdb)
 {
-	std::string bstr = kvdb.get(id);
+	isRestored = false;
+	kvdb.view(key(), [this](std::string_view bstr) { fromBinString(bstr); });
+	return isRestored;
+} // ~Read::load_db
+
+bool Read::load_db(KvdbCursor& cursor)
+{
+	isRestored = false;
+	cursor.view(key(), [this](std::string_view bstr) { fromBinString(bstr); });
+	return isRestored;
+}
+
+std::string Read::db_key(uint64_t readfile_idx, uint64_t read_num)
+{
+	uint64_t val = (readfile_idx << 48) | read_num;
+	std::string key(sizeof(val), 0);
+	for (int i = sizeof(val) - 1; i >= 0; --i, val >>= 8)
+		key[i] = static_cast<char>(val & 0xff);
+	return key;
+} // ~Read::db_key
+
+/*
+ * restore read alignment data from a string produced by 'toBinString'. Parses the string in place
+ */
+bool Read::fromBinString(std::string_view bstr, bool is_fatal)
+{
 	if (bstr.size() == 0) { isRestored = false; return isRestored; }
+	if (static_cast<unsigned char>(bstr[0]) == READ_REC_V1 && fromBinStringV1(bstr))
+		return isRestored;
+	// a legacy record can start with READ_REC_V1 as well, it is the low byte of 'lastIndex'
+	if (is_v0_record(bstr))
+		return fromBinStringV0(bstr);
+
+	if (is_fatal) {
+		ERR("Read ", id, ": corrupt record of ", bstr.size(), " bytes in the key-value DB");
+		exit(EXIT_FAILURE);
+	}
+	isRestored = false;
+	return isRestored;
+} // ~Read::fromBinString
+
+/*
+ * the record READ_REC_V1. The read is only updated if the whole string is a single valid record
+ */
+bool Read::fromBinStringV1(std::string_view bstr)
+{
+	RecReader rd{ reinterpret_cast<const unsigned char*>(bstr.data()) + 1, reinterpret_cast<const unsigned char*>(bstr.data()) + bstr.size() };
+	auto r_lastIndex = static_cast<unsigned>(rd.varint());
+	auto r_lastPart = static_cast<unsigned>(rd.varint());
+	auto r_c_yid_ycov = static_cast<unsigned>(rd.varint());
+	auto r_n_yid_ncov = static_cast<unsigned>(rd.varint());
+	auto r_n_nid_ycov = static_cast<unsigned>(rd.varint());
+	auto r_n_denovo = static_cast<unsigned>(rd.varint());
+	auto flags = rd.byte();
+	auto r_max_SW_count = static_cast<uint16_t>(rd.varint());
+	auto r_num_alignments = static_cast<int32_t>(unzigzag(rd.varint()));
+	auto r_hit_seeds = static_cast<uint32_t>(rd.varint());
+
+	alignment_struct2 r_alignment;
+	r_alignment.min_index = static_cast<uint32_t>(rd.varint());
+	r_alignment.max_index = static_cast<uint32_t>(rd.varint());
+	auto num_align = rd.varint();
+	if (num_align > rd.left())
+		rd.ok = false; // not a record, an alignment takes more than a byte
+	r_alignment.alignv.resize(rd.ok ? num_align : 0);
+	for (auto& align : r_alignment.alignv)
+	{
+		align.index_num = static_cast<uint16_t>(rd.varint());
+		align.part = static_cast<uint16_t>(rd.varint());
+		align.ref_num = static_cast<uint32_t>(rd.varint());
+		align.ref_begin1 = static_cast<int32_t>(unzigzag(rd.varint()));
+		align.ref_end1 = static_cast<int32_t>(align.ref_begin1 + unzigzag(rd.varint()));
+		align.read_begin1 = static_cast<int32_t>(unzigzag(rd.varint()));
+		align.read_end1 = static_cast<int32_t>(align.read_begin1 + unzigzag(rd.varint()));
+		align.readlen = static_cast<uint32_t>(rd.varint());
+		align.score1 = static_cast<uint16_t>(rd.varint());
+		align.strand = rd.byte() != 0;
+		auto cigar_len = rd.varint();
+		if (cigar_len > rd.left())
+			rd.ok = false;
+		align.cigar.resize(rd.ok ? cigar_len : 0);
+		for (auto& op : align.cigar)
+			op = static_cast<uint32_t>(rd.varint());
+		if (!rd.ok) break;
+	}
+
+	if (!rd.ok || rd.left() != 0)
+		return false;
+
+	lastIndex = r_lastIndex;
+	lastPart = r_lastPart;
+	c_yid_ycov = r_c_yid_ycov;
+	n_yid_ncov = r_n_yid_ncov;
+	n_nid_ycov = r_n_nid_ycov;
+	n_denovo = r_n_denovo;
+	is_done = flags & 1;
+	is_hit = flags & 2;
+	null_align_output = flags & 4;
+	max_SW_count = r_max_SW_count;
+	num_alignments = r_num_alignments;
+	hit_seeds = r_hit_seeds;
+	alignment = std::move(r_alignment);
+	isRestored = true;
+	return isRestored;
+} // ~Read::fromBinStringV1
+
+/*
+ * the fixed-width layout of the records written before READ_REC_V1
+ */
+bool Read::fromBinStringV0(std::string_view bstr)
+{
 	size_t offset = 0;
 
 	std::memcpy(static_cast<void*>(&lastIndex), bstr.data() + offset, sizeof(lastIndex));
@@ -536,7 +749,7 @@ bool Read::load_db(KeyValueDatabase& kvdb)
 
 	isRestored = true;
 	return isRestored;
-} // ~Read::load_db
+} // ~Read::fromBinStringV0
 
 /* deserialize matches from JSON and populate the read */
 void Read::unmarshallJson(KeyValueDatabase & kvdb)
@@ -610,6 +823,31 @@ uint32_t Read::hashKmer(uint32_t pos, uint32_t len)
 	return hash;
 }
 
+/*
+ * compute the hashes of all the k-mers on the read in a single pass over the 'isequence'
+ * Same as calling 'hashKmer' for each position, which is O(len) per k-mer
+ *
+ * @param len     k-mer length, at most 16
+ * @param hashes  OUT  hashes[pos] is the hash of the k-mer starting at 'pos'
+ */
+void Read::hashKmers(uint32_t len, std::vector<uint32_t>& hashes)
+{
+	if (len == 0 || isequence.size() < len) {
+		hashes.clear();
+		return;
+	}
+	hashes.resize(isequence.size() - len + 1);
+	const uint32_t mask = len < 16 ? (1u << (len << 1)) - 1 : ~0u; // keep the last 'len' nucleotides
+	uint32_t hash = 0;
+	for (uint32_t i = 0; i < len - 1; ++i)
+		(hash <<= 2) |= (uint32_t)isequence[i];
+	for (uint32_t i = len - 1; i < isequence.size(); ++i)
+	{
+		hash = ((hash << 2) | (uint32_t)isequence[i]) & mask;
+		hashes[i + 1 - len] = hash;
+	}
+}
+
 /* 
  * @param readstr 'read_id \n header \n sequence [\n quality]'
  */
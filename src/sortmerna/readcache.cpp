@@ -0,0 +1,102 @@
+/*
+@copyright 2016-2026 Clarity Genomics BVBA
+@copyright 2012-2016 Bonsai Bioinformatics Research Group
+@copyright 2014-2016 Knight Lab, Department of Pediatrics, UCSD, La Jolla
+
+@parblock
+SortMeRNA - next-generation reads filter for metatranscriptomic or total RNA
+
+This is a free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+SortMeRNA is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
+@endparblock
+
+@contributors Jenya Kopylova   jenya.kopylov@gmail.com
+              Laurent Noé      laurent.noe@lifl.fr
+              Pierre Pericard  pierre.pericard@lifl.fr
+              Daniel McDonald  wasade@gmail.com
+              Mikaël Salson    mikael.salson@lifl.fr
+              Hélène Touzet    helene.touzet@lifl.fr
+              Rob Knight       robknight@ucsd.edu
+              biocodz          biocodz@protonmail.com
+*/
+
+/**
+ * @file readcache.cpp
+ * @brief results of the read search shared between the Processor threads
+ */
+
+#include "readcache.hpp"
+#include "read.hpp"
+#include "common.hpp"
+
+#define READ_CACHE_SHARDS 64 // independently locked parts of the cache
+
+ReadCache::ReadCache(uint32_t capacity) : shards(READ_CACHE_SHARDS)
+{
+	shard_capacity = capacity / READ_CACHE_SHARDS;
+	if (shard_capacity == 0)
+		shard_capacity = 1;
+}
+
+ReadCache::Key ReadCache::make_key(Read& read, const std::string& bstr, uint16_t index_num, uint16_t part)
+{
+	std::string str = read.get04Seq();
+	str.push_back(static_cast<char>(5)); // separator. Not in the 04 alphabet
+	str.append(static_cast<const char*>(static_cast<const void*>(&index_num)), sizeof(index_num));
+	str.append(static_cast<const char*>(static_cast<const void*>(&part)), sizeof(part));
+	str += bstr;
+	auto hash = hash128(str);
+	return Key{ hash.first, hash.second };
+} // ~ReadCache::make_key
+
+bool ReadCache::get(const Key& key, Value& value)
+{
+	auto& sh = shard(key);
+	std::lock_guard<std::mutex> lock(sh.lock);
+	auto it = sh.map.find(key);
+	if (it == sh.map.end())
+		return false;
+	sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+	value = it->second->second;
+	return true;
+} // ~ReadCache::get
+
+void ReadCache::put(const Key& key, const Value& value)
+{
+	auto& sh = shard(key);
+	std::lock_guard<std::mutex> lock(sh.lock);
+	auto it = sh.map.find(key);
+	if (it != sh.map.end())
+	{
+		// another thread searched the same read meanwhile
+		sh.lru.splice(sh.lru.begin(), sh.lru, it->second);
+		return;
+	}
+	if (sh.map.size() >= shard_capacity)
+	{
+		sh.map.erase(sh.lru.back().first);
+		sh.lru.pop_back();
+	}
+	sh.lru.emplace_front(key, value);
+	sh.map.emplace(key, sh.lru.begin());
+} // ~ReadCache::put
+
+void ReadCache::clear()
+{
+	for (auto& sh : shards)
+	{
+		std::lock_guard<std::mutex> lock(sh.lock);
+		sh.map.clear();
+		sh.lru.clear();
+	}
+} // ~ReadCache::clear
@@ -169,6 +169,15 @@ std::string Readstats::toBstring()
 	std::copy_n(static_cast<char*>(static_cast<void*>(&is_stats_calc)), sizeof(is_stats_calc), std::back_inserter(buf));
 	// 13
 	std::copy_n(static_cast<char*>(static_cast<void*>(&is_set_aligned_id_cov)), sizeof(is_set_aligned_id_cov), std::back_inserter(buf));
+	// 14
+	size_t hits_size = hits.size();
+	std::copy_n(static_cast<char*>(static_cast<void*>(&hits_size)), sizeof(hits_size), std::back_inserter(buf));
+	// 14.1
+	for (auto const& bits : hits) {
+		size_t bits_size = bits.size();
+		std::copy_n(static_cast<char*>(static_cast<void*>(&bits_size)), sizeof(bits_size), std::back_inserter(buf));
+		std::copy_n(reinterpret_cast<const char*>(bits.data()), bits_size * sizeof(uint64_t), std::back_inserter(buf));
+	}
 	//
 	return buf;
 } // ~Readstats::toBstring
@@ -283,11 +292,67 @@ bool Readstats::restoreFromDb(KeyValueDatabase & kvdb)
 		// 13
 		std::memcpy(static_cast<void*>(&is_set_aligned_id_cov), bstr.data() + offset, sizeof(is_set_aligned_id_cov));
 		offset += sizeof(is_set_aligned_id_cov);
+
+		// 14 (not stored by the older versions). Every length is checked against the record,
+		// a bitmap that does not fit is dropped i.e. all the reads are looked up
+		hits.clear();
+		if (ret && offset + sizeof(size_t) <= bstr.size()) // not aligned with item 11 otherwise
+		{
+			size_t hits_size = 0;
+			std::memcpy(static_cast<void*>(&hits_size), bstr.data() + offset, sizeof(hits_size));
+			offset += sizeof(hits_size);
+			bool is_ok = hits_size <= (bstr.size() - offset) / sizeof(size_t); // a size per stream at least
+			if (is_ok)
+				hits.resize(hits_size);
+			// 14.1
+			for (auto it = hits.begin(); is_ok && it != hits.end(); ++it) {
+				size_t bits_size = 0;
+				is_ok = offset + sizeof(bits_size) <= bstr.size();
+				if (!is_ok) break;
+				std::memcpy(static_cast<void*>(&bits_size), bstr.data() + offset, sizeof(bits_size));
+				offset += sizeof(bits_size);
+				is_ok = bits_size <= (bstr.size() - offset) / sizeof(uint64_t);
+				if (!is_ok) break;
+				it->resize(bits_size);
+				std::memcpy(static_cast<void*>(it->data()), bstr.data() + offset, bits_size * sizeof(uint64_t));
+				offset += bits_size * sizeof(uint64_t);
+			}
+			if (!is_ok) {
+				WARN("the reads hit bitmap stored with the Readstats is corrupt. Looking up all the reads in the DB");
+				hits.clear();
+			}
+		}
 	} // ~if data found in DB
 
 	return ret;
 } // ~Readstats::restoreFromDb
 
+/*
+ * @param num_streams  number of the read streams, see 'Readfeed::num_split_files'
+ */
+void Readstats::init_hits(std::size_t num_streams)
+{
+	hits.assign(num_streams, std::vector<uint64_t>());
+}
+
+void Readstats::set_hit(uint64_t stream, uint64_t read_num)
+{
+	if (stream >= hits.size())
+		return;
+	auto& bits = hits[stream];
+	if ((read_num >> 6) >= bits.size())
+		bits.resize((read_num >> 6) + 1, 0);
+	bits[read_num >> 6] |= 1ULL << (read_num & 63);
+}
+
+bool Readstats::is_stored(uint64_t stream, uint64_t read_num) const
+{
+	if (stream >= hits.size())
+		return true; // not known
+	auto const& bits = hits[stream];
+	return (read_num >> 6) < bits.size() && (bits[read_num >> 6] >> (read_num & 63)) & 1;
+}
+
 void Readstats::store_to_db(KeyValueDatabase & kvdb)
 {
 	kvdb.put(dbkey, toBstring());
@@ -98,7 +98,7 @@ uint32_t table[4][16][14] = {
 	{10, 10, 14, 10, 14, 10, 14, 10, 14, 10, 14, 14, 10, 14}} };
 
 void traversetrie_align(
-	NodeElement* trie_t,
+	const FlatNodeElement* trie_t,
 	uint32_t lev_t,
 	UCHAR depth,
 	UCHAR* win_k1_ptr,
@@ -110,192 +110,222 @@ void traversetrie_align(
 	Runopts& opts
 )
 {
-	uint16_t lev_t_trie_pivot = lev_t;
-	unsigned char value = 0;
+	TrieTraversal trav;
+	trav.start(trie_t, win_k1_ptr, win_k1_full, win_num, partialwin, lev_t, depth);
+	trav.accept_zero_kmer = accept_zero_kmer;
+	trav.id_hits.swap(id_hits);
+	while (!trav.is_done)
+		trav.step(opts);
+	trav.id_hits.swap(id_hits);
+	accept_zero_kmer = trav.accept_zero_kmer;
+}//~traversetrie_align()
+
+void TrieTraversal::start(const FlatNodeElement* trie_t, UCHAR* k1_ptr, UCHAR* k1_full, uint32_t win, uint32_t pwin, uint32_t lev_t, uint32_t depth)
+{
+	win_k1_ptr = k1_ptr;
+	win_k1_full = k1_full;
+	win_num = win;
+	partialwin = pwin;
+	stack[0] = { trie_t, lev_t, depth, 0 };
+	top = 0;
+	bucket = NULL;
+	is_done = false;
+	__builtin_prefetch(trie_t);
+}
+
+void TrieTraversal::step(Runopts& opts)
+{
+	// the bucket found on the previous step. Its memory has been prefetched
+	if (bucket != NULL)
+	{
+		bool is_stop = scan_bucket(opts);
+		bucket = NULL;
+		if (is_stop)
+		{
+			is_done = true;
+			return;
+		}
+	}
 
-	// traverse the node elements (4: A,C,G,T) in a trie node
-	for (uint32_t node_element = 0; node_element < 4; node_element++)
+	while (top >= 0)
 	{
-		value = trie_t->flag;
+		Frame& frame = stack[top];
+		// all 4 node elements (A,C,G,T) visited, back to the parent trie node
+		if (frame.next == 4)
+		{
+			--top;
+			continue;
+		}
+
+		uint32_t node_element = frame.next++;
+		const FlatNodeElement* trie_t = frame.node + node_element;
 
 		// this node element is empty, go to next node element in trie node
-		if (value == 0)
+		if (trie_t->flag == 0) continue;
+
+		// node points to a trie node or a bucket
+		uint32_t lev_t;
+		if (frame.depth < partialwin - 2)
+		{
+			// send bv to LEV(1)
+			lev_t = table[0][(int)*(win_k1_ptr + (frame.depth << 2) + node_element)][(int)(frame.lev_pivot)];
+		}
+		else
 		{
-			lev_t = lev_t_trie_pivot;
-			trie_t++;
+			lev_t = table[3 - partialwin + frame.depth][(int)(*(win_k1_full + node_element) & ((2 << (partialwin - frame.depth)) - 1))][(int)(frame.lev_pivot)];
 		}
 
-		// node points to a trie node or a bucket, continue traversing
+		// LEV(1) is in a null state, go to next node element
+		if (lev_t == 14) continue;
+
+		// (1) the node element holds a pointer to another trie node: descend on the next step
+		if (trie_t->flag == 1)
+		{
+			const FlatNodeElement* child = flat_child(trie_t);
+			__builtin_prefetch(child);
+			stack[top + 1] = { child, lev_t, frame.depth + 1, 0 };
+			++top;
+			return;
+		}
+		// (2) the node element points to a bucket: scan it on the next step
 		else
 		{
-			if (depth < partialwin - 2)
+			const unsigned char* start_bucket = flat_bucket(trie_t);
+			for (uint32_t off = 0; off < trie_t->size; off += 64)
+				__builtin_prefetch(start_bucket + off);
+			bucket = trie_t;
+			bucket_lev = lev_t;
+			bucket_depth = frame.depth;
+			return;
+		}
+	}
+	is_done = true;
+}//~TrieTraversal::step
+
+bool TrieTraversal::scan_bucket(Runopts& opts)
+{
+	uint32_t lev_t = bucket_lev;
+	uint32_t depth = bucket_depth;
+
+	// this pivot remembers the target levenshtein state of the terminal trie node, from
+	//  which exists a bucket; every element in the bucket takes this lev_t state as an
+	//  initial input state
+	uint32_t lev_t_bucket_pivot = lev_t;
+
+	// number of characters per entry
+	uint32_t s = partialwin - depth;
+
+	const unsigned char* start_bucket = flat_bucket(bucket);
+	const unsigned char* end_bucket = start_bucket + bucket->size;
+
+	// traverse the bucket
+	while (start_bucket != end_bucket)
+	{
+		uint32_t depth_b = depth;
+		lev_t = lev_t_bucket_pivot;
+		bool local_accept_kmer = false;
+		uint32_t entry_str = *((const uint32_t*)start_bucket);
+
+		// for each nt in the string
+		for (uint32_t j = 0; j < s; j++)
+		{
+			uint32_t nt = entry_str & 3;
+
+			depth_b++;
+
+			// get bitvector for letter
+			if (depth_b < partialwin - 2)
 			{
-				// send bv to LEV(1)
-				lev_t = table[0][(int)*(win_k1_ptr + (depth << 2) + node_element)][(int)(lev_t)];
+				// send bv to LEV(_k)
+				lev_t = table[0][(int)*(win_k1_ptr + (depth_b << 2) + nt)][(int)(lev_t)];
 			}
 			else
 			{
-				lev_t = table[3 - partialwin + depth][(int)(*(win_k1_full + node_element) & ((2 << (partialwin - depth)) - 1))][(int)(lev_t)];
+				lev_t = table[3 - partialwin + depth_b][(int)(*(win_k1_full + nt) & ((2 << (partialwin - depth_b)) - 1))][(int)(lev_t)];
 			}
 
+			// if the target lev_t state is a failure state, go to the next bucket element (tail)
+			if (lev_t == 14) break;
 
-			// LEV(1) is in a null state, go to next node element
-			if (lev_t == 14)
-			{
-				lev_t = lev_t_trie_pivot;
-				trie_t++;
-			}
-			// LEV(1) is not in a null state, continue parallel traversal
-			else
+			// approaching end of tail
+			if (depth_b >= partialwin - 2)
 			{
-				// (1) the node element holds a pointer to another trie node
-				if (value == 1)
+				// 1-error match
+				if (lev_t >= 8)
 				{
-					traversetrie_align(trie_t->nodetype.trie,
-						lev_t,
-						++depth,
-						win_k1_ptr,
-						win_k1_full,
-						accept_zero_kmer,
-						id_hits,
-						win_num,
-						partialwin,
-						opts
-					);
-
-					// go to next window on the read (0-error match found)
-					if (accept_zero_kmer) return;
-
-					--depth;
-
-					// go to the next trie node element
-					lev_t = lev_t_trie_pivot;
-					trie_t++;
-				}//~ if (child node a trie node)                
-				// (2) the node element points to a bucket
-				else
+					local_accept_kmer = true;
+				}
+				// 0-error match
+				if (depth_b == partialwin - 1)
 				{
-					// this pivot remembers the target levenshtein state of the terminal trie node, from
-					//  which exists a bucket; every element in the bucket takes this lev_t state as an
-					//  initial input state
-					uint32_t lev_t_bucket_pivot = lev_t;
-
-					// number of characters per entry
-					uint32_t s = partialwin - depth;
-
-					unsigned char* start_bucket = (unsigned char*)trie_t->nodetype.bucket;
-					if (start_bucket == NULL)
+					if (lev_t == 9)
 					{
-						fprintf(stderr, "  ERROR: pointer start_bucket == NULL (paralleltraversal.cpp)\n");
-						exit(EXIT_FAILURE);
+						accept_zero_kmer = true;
+
+						// turn off heuristic to stop search after finding 0-error match
+						if (opts.is_full_search) accept_zero_kmer = false;
 					}
-					unsigned char* end_bucket = start_bucket + trie_t->size;
-					if (end_bucket == NULL)
+				}
+			}//~last 3 characters in entry
+
+			if (local_accept_kmer)
+			{
+				id_win entry = { 0,0 };
+				entry.id = *((const uint32_t*)start_bucket + 1);
+				entry.win = win_num;
+
+				// empty id_hits array, add 0-error id and exit
+				if (accept_zero_kmer)
+				{
+					id_hits.clear();
+					id_hits.push_back(entry);
+
+					return true;
+				}
+
+				// exact match not found, do not include duplicates of 1-error match (for the same window on read)
+				if (!id_hits.empty())
+				{
+					bool found = false;
+					for (uint32_t f = 0; f < id_hits.size(); f++)
 					{
-						fprintf(stderr, "  ERROR: pointer end_bucket == NULL (paralleltraversal.cpp)\n");
-						exit(EXIT_FAILURE);
+						if (id_hits[f].id == entry.id)
+						{
+							found = true;
+							break;
+						}
 					}
+					if (found) break;
+				}
 
-					// traverse the bucket
-					while (start_bucket != end_bucket)
-					{
-						uint32_t depth_b = depth;
-						lev_t = lev_t_bucket_pivot;
-						bool local_accept_kmer = false;
-						uint32_t entry_str = *((uint32_t*)start_bucket);
+				id_hits.push_back(entry);
 
-						// for each nt in the string
-						for (uint32_t j = 0; j < s; j++)
-						{
-							uint32_t nt = entry_str & 3;
-
-							depth_b++;
-
-							// get bitvector for letter
-							if (depth_b < partialwin - 2)
-							{
-								// send bv to LEV(_k)
-								lev_t = table[0][(int)*(win_k1_ptr + (depth_b << 2) + nt)][(int)(lev_t)];
-							}
-							else
-							{
-								lev_t = table[3 - partialwin + depth_b][(int)(*(win_k1_full + nt) & ((2 << (partialwin - depth_b)) - 1))][(int)(lev_t)];
-							}
-
-							// if the target lev_t state is a failure state, go to the next bucket element (tail)
-							if (lev_t == 14) break;
-
-							// approaching end of tail
-							if (depth_b >= partialwin - 2)
-							{
-								// 1-error match
-								if (lev_t >= 8)
-								{
-									local_accept_kmer = true;
-								}
-								// 0-error match
-								if (depth_b == partialwin - 1)
-								{
-									if (lev_t == 9)
-									{
-										accept_zero_kmer = true;
-
-										// turn off heuristic to stop search after finding 0-error match
-										if (opts.is_full_search) accept_zero_kmer = false;
-									}
-								}
-							}//~last 3 characters in entry
-
-							if (local_accept_kmer)
-							{
-								id_win entry = { 0,0 };
-								entry.id = *((uint32_t*)start_bucket + 1);
-								entry.win = win_num;
-
-								// empty id_hits array, add 0-error id and exit
-								if (accept_zero_kmer)
-								{
-									id_hits.clear();
-									id_hits.push_back(entry);
-
-									return;
-								}
-
-								// exact match not found, do not include duplicates of 1-error match (for the same window on read)
-								if (!id_hits.empty())
-								{
-									bool found = false;
-									for (uint32_t f = 0; f < id_hits.size(); f++)
-									{
-										if (id_hits[f].id == entry.id)
-										{
-											found = true;
-											break;
-										}
-									}
-									if (found) break;
-								}
-
-								id_hits.push_back(entry);
-
-							}
-							entry_str >>= 2;
-						}//~for each 2 bits
-
-						// next entry
-						start_bucket += ENTRYSIZE;
-					}//~for each entry
-
-					lev_t = lev_t_trie_pivot;
-					trie_t++;
-
-				}//~else the node element points to a bucket
-			}//~else LEV(1) is not in a null state, continue parallel traversal
-		}//~else this node element points to a trie node or a bucket, continue traversing
-	}//~for 4 node elements
+			}
+			entry_str >>= 2;
+		}//~for each 2 bits
 
-	return;
-}//~traversetrie_align()
+		// next entry
+		start_bucket += ENTRYSIZE;
+	}//~for each entry
+
+	return false;
+}//~TrieTraversal::scan_bucket
+
+void traversetrie_align_batch(TrieTraversal* trav, std::size_t n, Runopts& opts)
+{
+	// round-robin over the traversals in flight: while one of them waits
+	// for its prefetched node, the others make progress
+	for (std::size_t num_active = n; num_active > 0; )
+	{
+		num_active = 0;
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			if (trav[i].is_done) continue;
+			trav[i].step(opts);
+			if (!trav[i].is_done) ++num_active;
+		}
+	}
+}//~traversetrie_align_batch
 
 
 #ifdef see_binary_output
@@ -303,12 +333,12 @@ void traversetrie_align(
  *
  * @function traversetrie: collect statistics on the mini-burst trie,
  * its size, number of trie nodes vs. buckets
- * @param NodeElement* trie_node
+ * @param FlatNodeElement* trie_node
  * @return void
  * @version 1.0 Jan 14, 2013
  *
  *******************************************************************/
-void traversetrie_debug(NodeElement* trie_node, uint32_t depth, uint32_t &total_entries, string &kmer_keep, uint32_t partialwin)
+void traversetrie_debug(const FlatNodeElement* trie_node, uint32_t depth, uint32_t &total_entries, string &kmer_keep, uint32_t partialwin)
 {
 	char get_char[4] = { 'A','C','G','T' };
 
@@ -321,7 +351,7 @@ void traversetrie_debug(NodeElement* trie_node, uint32_t depth, uint32_t &total_
 		if (value == 1)
 		{
 			kmer_keep.push_back((char)get_char[i]); //TESTING
-			traversetrie_debug(trie_node->nodetype.trie, ++depth, total_entries, kmer_keep, partialwin);
+			traversetrie_debug(flat_child(trie_node), ++depth, total_entries, kmer_keep, partialwin);
 			kmer_keep.pop_back();
 			--depth;
 		}
@@ -331,18 +361,8 @@ void traversetrie_debug(NodeElement* trie_node, uint32_t depth, uint32_t &total_
 		{
 			kmer_keep.push_back((char)get_char[i]); //TESTING
 
-			unsigned char* start_bucket = (unsigned char*)trie_node->nodetype.bucket;
-			if (start_bucket == NULL)
-			{
-				fprintf(stderr, "  ERROR: pointer start_bucket == NULL (paralleltraversal.cpp)\n");
-				exit(EXIT_FAILURE);
-			}
-			unsigned char* end_bucket = start_bucket + trie_node->size;
-			if (end_bucket == NULL)
-			{
-				fprintf(stderr, "  ERROR: pointer end_bucket == NULL (paralleltraversal.cpp)\n");
-				exit(EXIT_FAILURE);
-			}
+			const unsigned char* start_bucket = flat_bucket(trie_node);
+			const unsigned char* end_bucket = start_bucket + trie_node->size;
 
 			cout << "size of bucket = " << trie_node->size << endl; //TESTING
 			cout << "end_bucket-start_bucket = " << (end_bucket - start_bucket) << endl; //TESTING
@@ -350,7 +370,7 @@ void traversetrie_debug(NodeElement* trie_node, uint32_t depth, uint32_t &total_
 			// traverse the bucket
 			while (start_bucket != end_bucket)
 			{
-				uint32_t entry_str = *((uint32_t*)start_bucket);
+				uint32_t entry_str = *((const uint32_t*)start_bucket);
 				uint32_t s = partialwin - depth;
 				total_entries++;
 
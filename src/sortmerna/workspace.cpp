@@ -0,0 +1,133 @@
+/*
+@copyright 2016-2026 Clarity Genomics BVBA
+@copyright 2012-2016 Bonsai Bioinformatics Research Group
+@copyright 2014-2016 Knight Lab, Department of Pediatrics, UCSD, La Jolla
+
+@parblock
+SortMeRNA - next-generation reads filter for metatranscriptomic or total RNA
+
+This is a free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+SortMeRNA is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with SortMeRNA. If not, see <http://www.gnu.org/licenses/>.
+@endparblock
+
+@contributors Jenya Kopylova   jenya.kopylov@gmail.com
+              Laurent Noé      laurent.noe@lifl.fr
+              Pierre Pericard  pierre.pericard@lifl.fr
+              Daniel McDonald  wasade@gmail.com
+              Mikaël Salson    mikael.salson@lifl.fr
+              Hélène Touzet    helene.touzet@lifl.fr
+              Rob Knight       robknight@ucsd.edu
+              biocodz          biocodz@protonmail.com
+*/
+
+/**
+ * @file workspace.cpp
+ * @brief per-thread scratch buffers for the read search
+ */
+
+#include <cstdlib> // std::malloc
+#include <new>
+#include <string_view>
+
+#include "parasail.h"
+#include "workspace.hpp"
+#include "options.hpp"
+
+/* Build a parasail scoring matrix for the ACGTN alphabet with SortMeRNA's scoring scheme.
+   score_N is applied to all pairs involving N (index 4), which may differ from mismatch.
+   The integer codes 0..4 (see 'nt_table') are mapped to A,C,G,T,N as well, so that parasail
+   aligns 'Read::isequence' and 'References::buffer' directly, without decoding them to characters. */
+static parasail_matrix_t* smr_create_matrix(int match, int mismatch, int score_N)
+{
+	parasail_matrix_t* mat = parasail_matrix_create("ACGTN", match, mismatch);
+	for (int j = 0; j < 5; ++j)
+		parasail_matrix_set_value(mat, 4, j, score_N); // N row
+	for (int i = 0; i < 4; ++i)
+		parasail_matrix_set_value(mat, i, 4, score_N); // N column
+	int* mapper = const_cast<int*>(&mat->mapper[0]); // allocated by parasail_matrix_create
+	for (int c = 0; c < 5; ++c)
+		mapper[c] = c;
+	return mat;
+}
+
+Workspace::Workspace(Runopts& opts)
+	: trav(TRAVERSAL_BATCH), match_head(0), profile(nullptr)
+{
+	matrix = smr_create_matrix(opts.match, opts.mismatch, opts.score_N);
+}
+
+Workspace::~Workspace()
+{
+	if (profile) parasail_profile_free(profile);
+	parasail_matrix_free(matrix);
+}
+
+/*
+ * The LIS of the consecutive candidate references of a read usually anchor the read the same way,
+ * so the query slice to align, and hence its profile, stays the same across the candidates.
+ * The profile keeps a pointer to its query => 'profile_seq' is not modified while the profile lives.
+ */
+parasail_profile* Workspace::query_profile(const char* seq, int len)
+{
+	if (profile == nullptr || profile_seq != std::string_view(seq, len))
+	{
+		if (profile) parasail_profile_free(profile);
+		profile_seq.assign(seq, len);
+		profile = parasail_profile_create_sat(profile_seq.data(), len, matrix);
+	}
+	return profile;
+}
+
+#ifdef SMR_ALLOC_COUNTER
+/*
+ * Development build only (cmake -DWITH_ALLOC_COUNTER=ON): replaces the global operator new
+ * to count the heap allocations per thread. See the Processor thread summary in align2.
+ */
+static thread_local uint64_t alloc_count = 0;
+
+uint64_t thread_alloc_count()
+{
+	return alloc_count;
+}
+
+void* operator new(std::size_t size)
+{
+	++alloc_count;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	++alloc_count;
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#endif
@@ -35,6 +35,12 @@
 #include <string>
 #include <vector>
 #include <iomanip> // setprecision
+#include <random>
+#include <chrono>
+#include <map>
+#include <fstream>
+#include <filesystem>
+#include <memory> // unique_ptr
 
 #include "readfeed.hpp"
 #include "ThreadPool.hpp"
@@ -44,6 +50,8 @@
 #include "refstats.hpp"
 #include "references.hpp"
 #include "read.hpp"
+#include "bitvector.hpp" // init_win_f
+#include "traverse_bursttrie.hpp"
 
 // forward
 void kvdb_clear();
@@ -221,8 +229,376 @@ void test_3(int argc, char** argv)
 	//char** ptrToCstr = &cstr;
 }
 
+/**
+ * Case 4
+ * Microbenchmark: hash the half windows (partialwin = 9) at every read position, forward and rear,
+ * as 'traverse' does with skip length 1: 'Read::hashKmer' per window vs 'Read::hashKmers' once per read.
+ *
+ * test.exe 4 100000
+ *
+ * @param num_reads number of random reads of each length (150 bp and 300 bp)
+ * @return number of the windows whose hashes differ
+ */
+size_t test_4(size_t num_reads)
+{
+	size_t num_fail = 0;
+	const uint32_t partialwin = 9;
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> nt(0, 3);
+	for (std::size_t read_len : { 150, 300 })
+	{
+		std::vector<Read> reads(num_reads);
+		for (auto& read : reads) {
+			for (std::size_t i = 0; i < read_len; ++i)
+				read.isequence += static_cast<char>(nt(gen));
+		}
+		const uint32_t numwin = static_cast<uint32_t>(read_len) - 2 * partialwin + 1;
+		uint64_t sum_1 = 0;
+		uint64_t sum_2 = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto& read : reads) {
+			for (uint32_t win_pos = 0; win_pos < numwin; ++win_pos)
+				sum_1 += read.hashKmer(win_pos, partialwin) + read.hashKmer(win_pos + partialwin, partialwin);
+		}
+		std::chrono::duration<double> t_1 = std::chrono::high_resolution_clock::now() - start;
+
+		std::vector<uint32_t> hashes;
+		start = std::chrono::high_resolution_clock::now();
+		for (auto& read : reads) {
+			read.hashKmers(partialwin, hashes);
+			for (uint32_t win_pos = 0; win_pos < numwin; ++win_pos)
+				sum_2 += hashes[win_pos] + hashes[win_pos + partialwin];
+		}
+		std::chrono::duration<double> t_2 = std::chrono::high_resolution_clock::now() - start;
+
+		// the sums only keep the timed loops from being optimized out. Compare every window
+		size_t num_diff = 0;
+		for (auto& read : reads) {
+			read.hashKmers(partialwin, hashes);
+			for (uint32_t win_pos = 0; win_pos + partialwin <= read_len; ++win_pos) {
+				if (hashes[win_pos] != read.hashKmer(win_pos, partialwin))
+					++num_diff;
+			}
+		}
+		num_fail += num_diff;
+
+		std::cout << STAMP << "Read length: " << read_len << " Reads: " << num_reads
+			<< " hashKmer: " << std::setprecision(4) << std::fixed << t_1.count() << " sec"
+			<< " hashKmers: " << t_2.count() << " sec"
+			<< (num_diff == 0 ? " Hashes match" : " ERROR: hashes differ in windows: ");
+		if (num_diff > 0) std::cout << num_diff;
+		std::cout << std::endl;
+	}
+	return num_fail;
+} // ~test_4
+
+/*
+ * the read record of the fixed-width layout used before READ_REC_V1 (see 'Read::fromBinStringV0')
+ */
+static std::string legacy_record(Read& read)
+{
+	std::string buf;
+	auto put = [&buf](const void* val, std::size_t size) { buf.append(static_cast<const char*>(val), size); };
+	put(&read.lastIndex, sizeof(read.lastIndex));
+	put(&read.lastPart, sizeof(read.lastPart));
+	put(&read.c_yid_ycov, sizeof(read.c_yid_ycov));
+	put(&read.n_yid_ncov, sizeof(read.n_yid_ncov));
+	put(&read.n_nid_ycov, sizeof(read.n_nid_ycov));
+	put(&read.n_denovo, sizeof(read.n_denovo));
+	put(&read.is_done, sizeof(read.is_done));
+	put(&read.is_hit, sizeof(read.is_hit));
+	put(&read.null_align_output, sizeof(read.null_align_output));
+	put(&read.max_SW_count, sizeof(read.max_SW_count));
+	put(&read.num_alignments, sizeof(read.num_alignments));
+	put(&read.hit_seeds, sizeof(read.hit_seeds));
+	std::string alignment_str = read.alignment.toString();
+	std::size_t alignment_size = alignment_str.size();
+	put(&alignment_size, sizeof(alignment_size));
+	return buf + alignment_str;
+}
+
+static bool is_same_record(Read& a, Read& b)
+{
+	bool is_same = a.lastIndex == b.lastIndex && a.lastPart == b.lastPart
+		&& a.c_yid_ycov == b.c_yid_ycov && a.n_yid_ncov == b.n_yid_ncov && a.n_nid_ycov == b.n_nid_ycov && a.n_denovo == b.n_denovo
+		&& a.is_done == b.is_done && a.is_hit == b.is_hit && a.null_align_output == b.null_align_output
+		&& a.max_SW_count == b.max_SW_count && a.num_alignments == b.num_alignments && a.hit_seeds == b.hit_seeds
+		&& a.alignment.min_index == b.alignment.min_index && a.alignment.max_index == b.alignment.max_index
+		&& a.alignment.alignv.size() == b.alignment.alignv.size();
+	for (std::size_t i = 0; is_same && i < a.alignment.alignv.size(); ++i)
+		is_same = a.alignment.alignv[i] == b.alignment.alignv[i];
+	return is_same;
+}
+
+/**
+ * Case 5
+ * Round trip of the read records ('Read::toBinString', 'Read::fromBinString') with random alignments,
+ * also through the in-memory key-value DB ('Read::load_db'), and the size and the speed against
+ * the legacy fixed-width records. The truncated records have to be rejected, and the legacy records
+ * starting with READ_REC_V1 decoded as such.
+ *
+ * test.exe 5 100000
+ *
+ * @param num_reads number of reads of each number of alignments (1 and 10)
+ * @return number of the failed checks
+ */
+size_t test_5(size_t num_reads)
+{
+	size_t num_fail = 0;
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<uint32_t> rnd(0, 1u << 20);
+	for (std::size_t num_align : { 1, 10 })
+	{
+		std::vector<Read> reads(num_reads);
+		for (auto& read : reads) {
+			read.lastIndex = rnd(gen) % 4;
+			read.lastPart = rnd(gen) % 16;
+			read.c_yid_ycov = rnd(gen) % 3;
+			read.n_yid_ncov = rnd(gen) % 3;
+			read.n_nid_ycov = rnd(gen) % 300;
+			read.n_denovo = rnd(gen) % 2;
+			read.is_done = rnd(gen) % 2;
+			read.is_hit = true;
+			read.max_SW_count = rnd(gen) % 3;
+			read.num_alignments = static_cast<int32_t>(rnd(gen) % 3) - 1;
+			read.hit_seeds = rnd(gen) % 200;
+			for (std::size_t i = 0; i < num_align; ++i) {
+				s_align2 align;
+				align.ref_num = rnd(gen);
+				align.ref_begin1 = rnd(gen) % 2000;
+				align.ref_end1 = align.ref_begin1 + rnd(gen) % 300;
+				align.read_begin1 = rnd(gen) % 20;
+				align.read_end1 = align.read_begin1 + rnd(gen) % 300;
+				align.readlen = 150 + rnd(gen) % 150;
+				align.score1 = rnd(gen) % 600;
+				align.part = rnd(gen) % 16;
+				align.index_num = rnd(gen) % 4;
+				align.strand = rnd(gen) % 2;
+				for (auto n = rnd(gen) % 8 + 1; n > 0; --n)
+					align.cigar.push_back((rnd(gen) % 150) << 4 | rnd(gen) % 9);
+				read.alignment.alignv.push_back(align);
+			}
+			read.alignment.min_index = rnd(gen) % num_align;
+			read.alignment.max_index = rnd(gen) % num_align;
+		}
+
+		std::vector<std::string> recs(num_reads);
+		std::vector<std::string> recs_0(num_reads);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (std::size_t i = 0; i < num_reads; ++i)
+			recs[i] = reads[i].toBinString();
+		std::chrono::duration<double> t_enc = std::chrono::high_resolution_clock::now() - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (std::size_t i = 0; i < num_reads; ++i)
+			recs_0[i] = legacy_record(reads[i]);
+		std::chrono::duration<double> t_enc_0 = std::chrono::high_resolution_clock::now() - start;
+
+		std::size_t num_bad = 0;
+		std::size_t size = 0;
+		std::size_t size_0 = 0;
+		Read read;
+		start = std::chrono::high_resolution_clock::now();
+		for (std::size_t i = 0; i < num_reads; ++i) {
+			read.fromBinString(recs[i]);
+			if (!read.isRestored || !is_same_record(read, reads[i])) ++num_bad;
+			size += recs[i].size();
+		}
+		std::chrono::duration<double> t_dec = std::chrono::high_resolution_clock::now() - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (std::size_t i = 0; i < num_reads; ++i) {
+			read.fromBinString(recs_0[i]);
+			if (!read.isRestored || !is_same_record(read, reads[i])) ++num_bad;
+			size_0 += recs_0[i].size();
+		}
+		std::chrono::duration<double> t_dec_0 = std::chrono::high_resolution_clock::now() - start;
+
+		// decoded in place from the DB value
+		KeyValueDatabase kvdb("", KvdbType::memory);
+		for (std::size_t i = 0; i < num_reads; ++i) {
+			reads[i].read_num = i;
+			kvdb.put(reads[i].key(), recs[i]);
+		}
+		for (std::size_t i = 0; i < num_reads; ++i) {
+			Read rread;
+			rread.read_num = i;
+			if (!rread.load_db(kvdb) || !is_same_record(rread, reads[i])) ++num_bad;
+		}
+
+		// every prefix of a record misses some fields. The read keeps its values
+		std::size_t num_corrupt = 0;
+		read.fromBinString(recs[0]);
+		for (std::size_t i = 0; i < num_reads && i < 100; ++i) {
+			for (std::size_t len = 1; len < recs[i].size(); ++len) {
+				if (read.fromBinString(std::string_view(recs[i]).substr(0, len), false) || !is_same_record(read, reads[0])) ++num_corrupt;
+			}
+			for (std::size_t len = 1; len < recs_0[i].size(); ++len) {
+				if (read.fromBinString(std::string_view(recs_0[i]).substr(0, len), false) || !is_same_record(read, reads[0])) ++num_corrupt;
+			}
+		}
+		// varint longer than 64 bits
+		if (read.fromBinString(std::string(1, static_cast<char>(READ_REC_V1)) + std::string(11, '\xff'), false)) ++num_corrupt;
+
+		// legacy record starting with READ_REC_V1: the low byte of 'lastIndex'
+		for (std::size_t i = 0; i < num_reads && i < 100; ++i) {
+			reads[i].lastIndex = READ_REC_V1;
+			if (!read.fromBinString(legacy_record(reads[i]), false) || !is_same_record(read, reads[i])) ++num_bad;
+		}
+
+		std::cout << STAMP << "Alignments per read: " << num_align << " Reads: " << num_reads
+			<< " Bytes per read: " << size / num_reads << " (legacy " << size_0 / num_reads << ")"
+			<< " Encode: " << std::setprecision(4) << std::fixed << t_enc.count() << " sec (legacy " << t_enc_0.count() << ")"
+			<< " Decode: " << t_dec.count() << " sec (legacy " << t_dec_0.count() << ")"
+			<< (num_bad == 0 ? " Records match" : " ERROR: records differ")
+			<< (num_corrupt == 0 ? " Corrupt records rejected" : " ERROR: corrupt records accepted") << std::endl;
+		num_fail += num_bad + num_corrupt;
+	}
+	return num_fail;
+} // ~test_5
+
+/* index of the reference 'ref_file' built into 'workdir' with 'threads'. The parts are loaded by the caller */
+static std::unique_ptr<Runopts> build_test_index(const std::string& ref_file, const std::string& workdir, const std::string& threads)
+{
+	std::vector<std::string> args = { "sortmerna", "-ref", ref_file, "-reads", ref_file, "-workdir", workdir,
+		"--threads", threads, "-index", "1" };
+	std::vector<char*> argv;
+	for (auto& arg : args)
+		argv.push_back(&arg[0]);
+	auto opts = std::make_unique<Runopts>(static_cast<int>(argv.size()), argv.data());
+	Index index(*opts);
+	return opts;
+}
+
+/**
+ * Case 6
+ * Round trip of the flat index: builds the index of random references (with repeats) in 'workdir' with
+ * 1 and 4 threads, and checks that
+ *   - the index files '.dat' are the same,
+ *   - the positions of every L-mer decoded from the index ('PositionsCursor') are the L-mer positions on the references,
+ *   - 'Index::find_exact' gives the same (L+1)-mer as the first 0-error hit of the trie traversal.
+ *
+ * test.exe 6 /tmp/smr_test_6
+ *
+ * @param workdir  directory of the references and the two index builds. Removed first
+ * @return number of the failed checks
+ */
+size_t test_6(const std::string& workdir)
+{
+	size_t num_fail = 0;
+	std::filesystem::remove_all(workdir);
+	std::filesystem::create_directories(workdir);
+
+	// sequences in 0-3 encoding. The last one repeats a part of the first, the second has a tandem repeat
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> nt(0, 3);
+	std::vector<std::string> seqs(3);
+	for (auto& seq : seqs) {
+		for (std::size_t i = 0; i < 2000; ++i)
+			seq += static_cast<char>(nt(gen));
+	}
+	seqs[1] += seqs[1].substr(100, 50) + seqs[1].substr(100, 50);
+	seqs[2] += seqs[0].substr(500, 300);
+
+	const std::string ref_file = workdir + "/ref.fasta";
+	{
+		std::ofstream ofs(ref_file, std::ios::binary);
+		for (std::size_t i = 0; i < seqs.size(); ++i) {
+			ofs << ">seq_" << i << "\n";
+			for (auto c : seqs[i]) ofs << "ACGT"[static_cast<int>(c)];
+			ofs << "\n";
+		}
+	}
+
+	// 1. the same index files whatever the number of the build threads
+	auto opts = build_test_index(ref_file, workdir + "/t1", "1");
+	auto opts_4 = build_test_index(ref_file, workdir + "/t4", "4");
+	std::size_t num_dat = 0;
+	for (auto const& entry : std::filesystem::directory_iterator(workdir + "/t1/idx"))
+	{
+		auto name = entry.path().filename().string();
+		if (name.find(".dat") == std::string::npos) continue;
+		std::ifstream ifs_1(entry.path(), std::ios::binary);
+		std::ifstream ifs_4(workdir + "/t4/idx/" + name, std::ios::binary);
+		std::string dat_1((std::istreambuf_iterator<char>(ifs_1)), std::istreambuf_iterator<char>());
+		std::string dat_4((std::istreambuf_iterator<char>(ifs_4)), std::istreambuf_iterator<char>());
+		if (dat_1.empty() || dat_1 != dat_4) ++num_fail;
+		++num_dat;
+	}
+	std::cout << STAMP << "Index files: " << num_dat << (num_fail == 0 ? " Same for 1 and 4 threads" : " ERROR: differ for 1 and 4 threads") << std::endl;
+	if (num_dat == 0) ++num_fail;
+
+	// expected positions [seq, pos] of each L-mer that starts an (L+1)-mer
+	const uint32_t lnwin = opts->seed_win_len;
+	const uint32_t partialwin = lnwin / 2;
+	auto hash = [](const std::string& seq, std::size_t pos, uint32_t len) {
+		uint32_t val = 0;
+		for (std::size_t i = pos; i < pos + len; ++i)
+			val = val << 2 | static_cast<uint32_t>(seq[i]);
+		return val;
+	};
+	std::map<std::string, std::vector<std::pair<uint32_t, uint32_t>>> lmer_pos;
+	for (uint32_t i = 0; i < seqs.size(); ++i) {
+		for (uint32_t pos = 0; pos + lnwin + 1 <= seqs[i].size(); ++pos)
+			lmer_pos[seqs[i].substr(pos, lnwin)].emplace_back(i, pos);
+	}
+
+	KeyValueDatabase kvdb("", KvdbType::memory);
+	Readstats readstats(1, seqs[0].size(), static_cast<uint32_t>(seqs[0].size()), static_cast<uint32_t>(seqs[0].size()), kvdb, *opts);
+	Refstats refstats(*opts, readstats);
+	if (refstats.num_index_parts[0] != 1) {
+		std::cout << STAMP << "ERROR: expected a single index part, got " << refstats.num_index_parts[0] << std::endl;
+		return num_fail + 1;
+	}
+	Index index;
+	index.load(0, 0, opts->indexfiles, refstats);
+
+	// 2. positions and 3. exact L-mers against the trie traversal
+	const uint32_t bitvec_size = (partialwin - 2) << 2;
+	const uint32_t offset = (partialwin - 3) << 2;
+	std::vector<UCHAR> bitvec(bitvec_size);
+	TrieTraversal trav;
+	std::size_t num_bad_pos = 0;
+	std::size_t num_bad_exact = 0;
+	for (auto const& lmer : lmer_pos)
+	{
+		uint32_t id = 0;
+		if (!index.find_exact(hash(lmer.first, 0, partialwin), hash(lmer.first, partialwin, partialwin), id)) {
+			++num_bad_exact;
+			continue;
+		}
+
+		std::vector<std::pair<uint32_t, uint32_t>> positions;
+		auto cursor = index.positions(id);
+		while (cursor.next_ref()) {
+			while (cursor.left > 0) {
+				uint32_t pos = cursor.next_pos();
+				positions.emplace_back(cursor.seq, pos);
+			}
+		}
+		if (positions != lmer.second) ++num_bad_pos;
+
+		std::string window = lmer.first; // 'init_win_f' takes a mutable pointer
+		std::fill(bitvec.begin(), bitvec.end(), 0);
+		init_win_f(&window[partialwin], &bitvec[0], &bitvec[4], static_cast<int>(refstats.numbvs[0]));
+		trav.id_hits.clear();
+		trav.accept_zero_kmer = false;
+		trav.start(index.trie_F(hash(lmer.first, 0, partialwin)), &bitvec[0], &bitvec[offset], 0, partialwin);
+		traversetrie_align_batch(&trav, 1, *opts);
+		if (!trav.accept_zero_kmer || trav.id_hits.size() != 1 || trav.id_hits[0].id != id) ++num_bad_exact;
+	}
+
+	std::cout << STAMP << "L-mers: " << lmer_pos.size()
+		<< (num_bad_pos == 0 ? " Positions match" : " ERROR: positions differ")
+		<< (num_bad_exact == 0 ? " Exact L-mers match the trie traversal" : " ERROR: exact L-mers differ from the trie traversal") << std::endl;
+	num_fail += num_bad_pos + num_bad_exact;
+	return num_fail;
+} // ~test_6
+
 int main(int argc, char** argv)
 {
+	int ret = 0;
 	std::cout << STAMP << "Running with " << argc << " options" << std::endl;
 	//Runopts opts(argc, argv, false);
 	if (argc > 2)
@@ -268,6 +644,18 @@ int main(int argc, char** argv)
 		case 3:
 			test_3(argc, argv);
 			break;
+		case 4:
+			if (test_4(std::stoul(argv[2])) > 0)
+				ret = 1;
+			break;
+		case 5:
+			if (test_5(std::stoul(argv[2])) > 0)
+				ret = 1;
+			break;
+		case 6:
+			if (test_6(argv[2]) > 0)
+				ret = 1;
+			break;
 		default:
 			std::cout << "Unknown arg: " << scase << std::endl;
 		}
@@ -277,5 +665,5 @@ int main(int argc, char** argv)
 		std::cerr << "Expecting at least one argument: test case e.g. 0 | 1 | 2 etc." << std::endl;
 	}
 
-	return 0;
+	return ret;
 } // ~main
\ No newline at end of file